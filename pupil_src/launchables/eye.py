@@ -306,6 +306,8 @@ def eye(
             session_settings.get("last_pupil_detector", Detector_2D.__name__)
         ]
         g_pool.pupil_detector = last_pupil_detector(g_pool, pupil_detector_settings)
+        # the algorithm view is only drawn when the window is updated
+        g_pool.pupil_detector.deferred_visualization = True
 
         def set_display_mode_info(val):
             g_pool.display_mode = val
@@ -315,6 +317,7 @@ def eye(
             g_pool.pupil_detector.deinit_ui()
             g_pool.pupil_detector.cleanup()
             g_pool.pupil_detector = new_detector(g_pool)
+            g_pool.pupil_detector.deferred_visualization = True
             g_pool.pupil_detector.init_ui()
 
         def toggle_general_settings(collapsed):
@@ -628,6 +631,25 @@ def eye(
                         except (ValueError, TypeError):
                             logger.error("Invalid property or value")
                             logger.debug(traceback.format_exc())
+                elif notification["subject"].startswith("pupil_detector.set_threads"):
+                    target_process = notification.get("target", g_pool.process)
+                    if target_process == g_pool.process:
+                        if isinstance(g_pool.pupil_detector, Detector_3D):
+                            # omitted settings keep their current values
+                            current = g_pool.pupil_detector.get_settings()[
+                                "Thread_Settings"
+                            ]
+                            g_pool.pupil_detector.configure_threads(
+                                notification.get("count", current["count"]),
+                                notification.get("cpus", current["cpus"]),
+                                notification.get(
+                                    "refinements", current["refinements"]
+                                ),
+                            )
+                        else:
+                            logger.error(
+                                "Threads can only be set if the 3d detector is active"
+                            )
                 elif notification["subject"].startswith(
                     "pupil_detector.broadcast_properties"
                 ):
@@ -722,6 +744,7 @@ def eye(
                     if frame:
                         # switch to work in normalized coordinate space
                         if g_pool.display_mode == "algorithm":
+                            g_pool.pupil_detector.render_visualization(frame)
                             g_pool.image_tex.update_from_ndarray(frame.img)
                         elif g_pool.display_mode in ("camera_image", "roi"):
                             g_pool.image_tex.update_from_ndarray(frame.gray)
@@ -55,6 +55,34 @@ namespace singleeyefitter {
     // general time
     typedef std::chrono::steady_clock Clock;
 
+    // a timestamp in seconds as time point, to measure the time between observations instead of the time passed
+    inline Clock::time_point timestampToTimePoint(double timestamp)
+    {
+        return Clock::time_point(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timestamp)));
+    }
+
+
+    // steady clock ticks spent in the stages of Detector2D::detect
+    // only filled if Detector2DProperties::collect_timings is set, stages which were not reached stay zero
+    // they are the timings of the detection whose result is returned, failed tracking windows and a coarse level
+    // which full resolution doesn't confirm are not included
+    struct Detector2DTimings {
+        Clock::rep histogram = 0;
+        Clock::rep masks = 0; // dark and spectral glint masks
+        Clock::rep morphology_open = 0;
+        Clock::rep median_blur = 0;
+        Clock::rep canny = 0;
+        Clock::rep find_contours = 0;
+        Clock::rep split_contours = 0;
+        Clock::rep divide_contours = 0;
+        Clock::rep combinatorial_search = 0;
+        Clock::rep final_fitting = 0;
+    };
+
+    inline double ticksToMilliseconds(Clock::rep ticks)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::duration(ticks)).count();
+    }
 
     // every coordinates are relative to the roi
     struct Detector2DResult {
@@ -66,6 +94,7 @@ namespace singleeyefitter {
         double timestamp = 0.0;
         int image_width = 0;
         int image_height = 0;
+        Detector2DTimings timings;
 
     };
 
@@ -120,6 +149,10 @@ namespace singleeyefitter {
         float final_perimeter_ratio_range_max;
         float ellipse_true_support_min_dist;
         float support_pixel_ratio_exponent;
+        bool collect_timings;
+        bool tracking; // run the detection on a window around the pupil predicted from the last strong detections
+        float tracking_window_scale; // half size of the tracking window relative to the predicted major radius
+        bool pyramid_detection; // detect on half resolution first, then refine on full resolution around the coarse ellipse
 
     };
 
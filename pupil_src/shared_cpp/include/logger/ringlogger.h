@@ -0,0 +1,178 @@
+#ifndef RINGLOGGER_H__
+#define RINGLOGGER_H__
+
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+// messages below this level are removed at compile time, same values as LogLevel
+#ifndef PUPILLABS_MIN_LOG_LEVEL
+#define PUPILLABS_MIN_LOG_LEVEL 10
+#endif
+
+namespace pupillabs {
+
+enum struct LogLevel{ // same levels as in python
+    NOTSET = 0,
+    DEBUG = 10,
+    INFO = 20,
+    WARNING = 30,
+    ERROR = 40,
+    CRITICAL = 50
+};
+
+struct LogRecord{
+    int level;
+    char name[32];
+    char message[220];
+};
+
+// Bounded queue of log records, which any thread can write to without locks or allocations.
+// Every slot has a sequence number telling whether it is free for the writer of a given position
+// or holds the record for the reader of that position (D. Vyukov's bounded MPMC queue).
+// If the queue is full the record is dropped and counted.
+class LogRing{
+
+public:
+
+    explicit LogRing( size_t capacity = 1024 ) : mMask(roundUp(capacity) - 1), mSlots(new Slot[mMask + 1]),
+        mWritePosition(0), mReadPosition(0), mDropped(0)
+    {
+        for( size_t i = 0; i <= mMask; i++ ){
+            mSlots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    };
+
+    LogRing( const LogRing& ) = delete;
+    LogRing& operator=( const LogRing& ) = delete;
+
+    // the ring of this module, the Python side drains it
+    static LogRing& instance(){
+        static LogRing ring;
+        return ring;
+    };
+
+    bool push( LogLevel level, const char* name, const char* format, va_list args ){
+        size_t position = mWritePosition.load(std::memory_order_relaxed);
+        Slot* slot;
+
+        for(;;){
+            slot = &mSlots[position & mMask];
+            const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t difference = std::ptrdiff_t(sequence) - std::ptrdiff_t(position);
+
+            if( difference == 0 ){
+                if( mWritePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) )
+                    break;
+            }else if( difference < 0 ){
+                mDropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }else{
+                position = mWritePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        LogRecord& record = slot->record;
+        record.level = static_cast<int>(level);
+        std::strncpy(record.name, name, sizeof(record.name) - 1);
+        record.name[sizeof(record.name) - 1] = '\0';
+        std::vsnprintf(record.message, sizeof(record.message), format, args); // longer messages are cut
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    };
+
+    bool pop( LogRecord& record ){
+        size_t position = mReadPosition.load(std::memory_order_relaxed);
+        Slot* slot;
+
+        for(;;){
+            slot = &mSlots[position & mMask];
+            const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t difference = std::ptrdiff_t(sequence) - std::ptrdiff_t(position + 1);
+
+            if( difference == 0 ){
+                if( mReadPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) )
+                    break;
+            }else if( difference < 0 ){
+                return false; // empty
+            }else{
+                position = mReadPosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        record = slot->record;
+        slot->sequence.store(position + mMask + 1, std::memory_order_release);
+        return true;
+    };
+
+    // number of records dropped since the last call
+    size_t takeDropped(){ return mDropped.exchange(0, std::memory_order_relaxed); };
+
+private:
+
+    struct Slot{
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+
+    static size_t roundUp( size_t capacity ){
+        size_t size = 2;
+        while( size < capacity ) size *= 2;
+        return size;
+    };
+
+    const size_t mMask;
+    std::unique_ptr<Slot[]> mSlots;
+    // readers and writers on separate cache lines
+    alignas(64) std::atomic<size_t> mWritePosition;
+    alignas(64) std::atomic<size_t> mReadPosition;
+    alignas(64) std::atomic<size_t> mDropped;
+};
+
+// Native replacement of PyCppLogger, which neither needs the GIL nor allocates.
+// The messages are printf formatted into the records of a LogRing.
+class RingLogger{
+
+public:
+
+    explicit RingLogger( const char* name, LogRing& ring = LogRing::instance() ) : mRing(ring), mLevel(static_cast<int>(LogLevel::DEBUG)) {
+        std::strncpy(mName, name, sizeof(mName) - 1);
+        mName[sizeof(mName) - 1] = '\0';
+    };
+
+    void setLogLevel( LogLevel level ){ mLevel.store(static_cast<int>(level), std::memory_order_relaxed); };
+    bool isEnabledFor( LogLevel level ) const {
+        return static_cast<int>(level) >= PUPILLABS_MIN_LOG_LEVEL && static_cast<int>(level) >= mLevel.load(std::memory_order_relaxed);
+    };
+
+    // the arguments are printf formatted, so strings have to be passed as const char*
+    template<LogLevel level>
+    void log( const char* format, ... ){
+        if( static_cast<int>(level) < PUPILLABS_MIN_LOG_LEVEL ) return; // resolved at compile time
+        if( static_cast<int>(level) < mLevel.load(std::memory_order_relaxed) ) return;
+
+        va_list args;
+        va_start(args, format);
+        mRing.push(level, mName, format, args);
+        va_end(args);
+    };
+
+    template<typename... Args> void debug( const char* format, Args... args ){ log<LogLevel::DEBUG>(format, args...); };
+    template<typename... Args> void info( const char* format, Args... args ){ log<LogLevel::INFO>(format, args...); };
+    template<typename... Args> void warn( const char* format, Args... args ){ log<LogLevel::WARNING>(format, args...); };
+    template<typename... Args> void error( const char* format, Args... args ){ log<LogLevel::ERROR>(format, args...); };
+    template<typename... Args> void critical( const char* format, Args... args ){ log<LogLevel::CRITICAL>(format, args...); };
+
+private:
+
+    LogRing& mRing;
+    std::atomic<int> mLevel;
+    char mName[32];
+};
+
+} // pupillabs
+
+#endif /* end of include guard: RINGLOGGER_H__ */
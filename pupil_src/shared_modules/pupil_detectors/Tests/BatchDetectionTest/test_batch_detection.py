@@ -0,0 +1,74 @@
+"""
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+"""
+
+import os
+
+import av
+import cv2
+import numpy as np
+
+from methods import Roi
+from pupil_detectors import Detector_2D
+from pupil_detectors.structured_result import PUPIL_2D_DTYPE
+
+single_data = os.path.join(
+    os.path.dirname(os.path.abspath(__file__)),
+    "../../../video_capture/tests/data/single/eye0.mp4",
+)
+
+FRAMES = 120
+
+
+class Frame:
+    def __init__(self, av_frame, timestamp):
+        self.img = av_frame.to_ndarray(format="bgr24")
+        self.gray = cv2.cvtColor(self.img, cv2.COLOR_BGR2GRAY)
+        self.height, self.width = self.gray.shape
+        self.timestamp = timestamp
+
+
+def frames(count):
+    container = av.open(single_data)
+    for index, av_frame in enumerate(container.decode(video=0)):
+        if index == count:
+            break
+        yield Frame(av_frame, index / 30.0)
+    container.close()
+
+
+def assert_same_records(records, expected):
+    assert records.dtype == expected.dtype
+    assert len(records) == len(expected)
+    for name in expected.dtype.names:
+        np.testing.assert_allclose(records[name], expected[name], rtol=0, atol=0, equal_nan=True, err_msg=name)
+
+
+def test_single_segment_equals_detect():
+    # one segment is detected in order by one detector, like the frames of the online detection
+    detector = Detector_2D()
+    expected = np.zeros(FRAMES, dtype=PUPIL_2D_DTYPE)
+    for index, frame in enumerate(frames(FRAMES)):
+        expected[index] = detector.detect(frame, Roi(frame.gray.shape), False, structured=True).record
+
+    records = Detector_2D().detect_batch(frames(FRAMES), segment_length=FRAMES, chunk_size=FRAMES)
+    assert_same_records(records, expected)
+
+
+def test_chunks_keep_segments():
+    detector = Detector_2D()
+    expected = detector.detect_batch(frames(FRAMES), segment_length=20, chunk_size=FRAMES)
+
+    # chunks are rounded down to whole segments, 50 frames are read as chunks of 40
+    blocks = list(detector.detect_batch_chunks(frames(FRAMES), segment_length=20, chunk_size=50))
+    assert [len(block) for block in blocks] == [40, 40, 40]
+    assert_same_records(np.concatenate(blocks), expected)
+
+    assert len(detector.detect_batch(iter([]))) == 0
@@ -0,0 +1,154 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// Compares BitsetList with std::set of the bit indices, for bitsets of 130 bits, i.e. three words with the
+// word boundaries between the bits 63 and 64 and between 127 and 128.
+
+#include <iostream>
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "BitsetList.h"
+
+
+using namespace singleeyefitter;
+
+typedef std::set<int> Bits;
+
+const int sBits = 130;
+
+void setBits(BitsetList::Word* bitset, const Bits& bits)
+{
+    for (int bit : bits) BitsetList::set(bitset, bit);
+}
+
+Bits bitsOf(const BitsetList::Word* bitset, int words)
+{
+    Bits bits;
+    BitsetList::forEachBit(bitset, words, [&](int bit) { bits.insert(bit); });
+    return bits;
+}
+
+bool isSubset(const Bits& a, const Bits& b)
+{
+    return std::includes(b.begin(), b.end(), a.begin(), a.end());
+}
+
+int main()
+{
+    std::cout << "Start Test" << std::endl;
+
+    int failed = 0;
+
+    // every single bit, forEachBit has to report exactly it
+    for (int bit = 0; bit < sBits; bit++) {
+        BitsetList list;
+        list.reset(sBits);
+        BitsetList::Word* bitset = list.push_back();
+        BitsetList::set(bitset, bit);
+
+        if (bitsOf(bitset, list.words()) != Bits{bit} || BitsetList::lowestBit(bitset[bit / 64]) != bit % 64)
+            failed++;
+    }
+
+    // the bits around the word boundary, in increasing order
+    {
+        BitsetList list;
+        list.reset(sBits);
+        const Bits bits = {0, 62, 63, 64, 65, 127, 128, 129};
+        BitsetList::Word* bitset = list.push_back();
+        setBits(bitset, bits);
+        std::vector<int> order;
+        BitsetList::forEachBit(bitset, list.words(), [&](int bit) { order.push_back(bit); });
+
+        if (order != std::vector<int>(bits.begin(), bits.end()))
+            failed++;
+
+        // subsets which differ only in the bits next to the boundary
+        BitsetList a, b;
+        a.reset(sBits);
+        b.reset(sBits);
+        setBits(a.push_back(), {63});
+        setBits(b.push_back(), {64});
+        setBits(b.push_back(), {63, 64});
+
+        if (!BitsetList::isSubset(a[0], b[1], a.words()) || BitsetList::isSubset(a[0], b[0], a.words()) ||
+                BitsetList::isSubset(b[0], a[0], a.words()) || !BitsetList::isSubset(b[0], b[1], b.words()) ||
+                BitsetList::isSubset(b[1], b[0], b.words()))
+            failed++;
+    }
+
+    // random bitsets, biased to the bits next to the word boundaries
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> anyBit(0, sBits - 1);
+    std::uniform_int_distribution<int> boundaryBit(62, 65);
+    std::uniform_int_distribution<int> count(0, 4);
+    int subsets = 0, contained = 0;
+
+    for (int round = 0; round < 1000; round++) {
+        BitsetList list;
+        list.reset(sBits);
+        std::vector<Bits> reference;
+
+        for (int i = 0; i < 8; i++) {
+            Bits bits;
+            const int n = count(generator);
+
+            for (int j = 0; j < n; j++) bits.insert(j % 2 ? anyBit(generator) : boundaryBit(generator));
+
+            setBits(list.push_back(), bits);
+            reference.push_back(bits);
+        }
+
+        for (size_t i = 0; i < reference.size(); i++) {
+            if (bitsOf(list[i], list.words()) != reference[i])
+                failed++;
+
+            for (size_t j = 0; j < reference.size(); j++) {
+                const bool subset = isSubset(reference[i], reference[j]);
+                subsets += subset;
+
+                if (BitsetList::isSubset(list[i], list[j], list.words()) != subset)
+                    failed++;
+            }
+        }
+
+        // the last bitset against a list of the others
+        BitsetList others;
+        others.reset(sBits);
+
+        for (size_t i = 0; i + 1 < reference.size(); i++) others.push_back(list[i]);
+
+        const bool expected = std::any_of(reference.begin(), reference.end() - 1, [&](const Bits & bits) { return isSubset(bits, reference.back()); });
+        contained += expected;
+
+        if (others.containsSubsetOf(list[list.size() - 1]) != expected)
+            failed++;
+    }
+
+    // a bitset is never found in an empty list
+    {
+        BitsetList list, other;
+        list.reset(sBits);
+        other.reset(sBits);
+
+        if (list.containsSubsetOf(other.push_back()))
+            failed++;
+    }
+
+    std::cout << "failed checks: " << failed << ", subsets: " << subsets << ", contained: " << contained << std::endl;
+
+    const bool passed = failed == 0 && subsets > 0 && contained > 0;
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,55 @@
+"""
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+"""
+
+# Builds the native 2D detector benchmark and runs it with the given arguments, e.g.
+#   python build_and_run_benchmark.py --video ~/recordings/2019_01_01/000/eye0.mp4
+
+if __name__ == "__main__":
+    import os
+    import subprocess as sp
+    import sys
+
+    os.chdir(os.path.dirname(os.path.abspath(__file__)))
+
+    opencv_flags = sp.run(
+        "pkg-config --cflags --libs opencv4 || pkg-config --cflags --libs opencv",
+        shell=True,
+        stdout=sp.PIPE,
+        universal_newlines=True,
+    ).stdout.strip()
+    if not opencv_flags:
+        opencv_flags = (
+            "-I/usr/local/opt/opencv/include -L/usr/local/opt/opencv/lib "
+            "-lopencv_core -lopencv_imgproc -lopencv_imgcodecs -lopencv_videoio"
+        )
+
+    sources = [
+        "detector2DBenchmark.cpp",
+        "../../singleeyefitter/ImageProcessing/cvx.cpp",
+        "../../singleeyefitter/utils.cpp",
+        "../../singleeyefitter/detectorUtils.cpp",
+    ]
+    include_dirs = [
+        "/usr/local/include/eigen3",
+        "/usr/include/eigen3",
+        "../../../../shared_cpp/include",
+        "../../singleeyefitter",
+        "../..",
+    ]
+    build_cmd = "g++ -std=c++11 -O2 -D_USE_MATH_DEFINES -w {includes} {sources} {opencv} -lpthread -o detector2DBenchmark".format(
+        includes=" ".join("-I" + d for d in include_dirs),
+        sources=" ".join(sources),
+        opencv=opencv_flags,
+    )
+    if sp.call(build_cmd, shell=True) != 0:
+        sys.exit("BUILD FAILED")
+    print("BUILD COMPLETE ______________________")
+    sys.exit(sp.call(["./detector2DBenchmark"] + sys.argv[1:]))
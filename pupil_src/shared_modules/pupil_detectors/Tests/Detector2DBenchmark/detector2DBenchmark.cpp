@@ -0,0 +1,287 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// Replays recorded grayscale eye frames through Detector2D::detect and reports
+// latency percentiles, throughput and the time spent in each detection stage.
+//
+// usage:
+//   detector2DBenchmark --video eye0.mp4
+//   detector2DBenchmark --dir frames/
+//   detector2DBenchmark --raw frames.gray --width 400 --height 400
+// options:
+//   --roi x,y,width,height   user roi, defaults to the full frame
+//   --repeat n               replay the frames n times (default 1)
+//   --warmup n               frames to run before measuring (default 10)
+//   --tracking 0|1           detect in a window around the predicted pupil (default 0)
+//   --pyramid 0|1            detect on half resolution and refine on full resolution (default 0)
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../../detect_2d.hpp"
+
+
+using namespace singleeyefitter;
+
+namespace {
+
+    // same defaults as Detector_2D in detector_2d.pyx
+    Detector2DProperties defaultProperties()
+    {
+        Detector2DProperties props;
+        props.intensity_range = 23;
+        props.blur_size = 5;
+        props.canny_treshold = 160;
+        props.canny_ration = 2;
+        props.canny_aperture = 5;
+        props.pupil_size_max = 100;
+        props.pupil_size_min = 10;
+        props.strong_perimeter_ratio_range_min = 0.6;
+        props.strong_perimeter_ratio_range_max = 1.1;
+        props.strong_area_ratio_range_min = 0.8;
+        props.strong_area_ratio_range_max = 1.1;
+        props.contour_size_min = 5;
+        props.ellipse_roundness_ratio = 0.09;
+        props.initial_ellipse_fit_treshhold = 4.3;
+        props.final_perimeter_ratio_range_min = 0.5;
+        props.final_perimeter_ratio_range_max = 1.0;
+        props.ellipse_true_support_min_dist = 3.0;
+        props.support_pixel_ratio_exponent = 2.0;
+        props.collect_timings = true;
+        props.tracking = false;
+        props.tracking_window_scale = 2.0;
+        props.pyramid_detection = false;
+        return props;
+    }
+
+    void toGray(const cv::Mat& frame, std::vector<cv::Mat>& frames)
+    {
+        if (frame.empty())
+            return;
+
+        if (frame.channels() == 1) {
+            frames.push_back(frame.clone());
+        } else {
+            cv::Mat gray;
+            cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+            frames.push_back(gray);
+        }
+    }
+
+    std::vector<cv::Mat> loadVideo(const std::string& path)
+    {
+        std::vector<cv::Mat> frames;
+        cv::VideoCapture capture(path);
+        cv::Mat frame;
+
+        while (capture.isOpened() && capture.read(frame)) {
+            toGray(frame, frames);
+        }
+
+        return frames;
+    }
+
+    std::vector<cv::Mat> loadDirectory(const std::string& path)
+    {
+        std::vector<cv::Mat> frames;
+        std::vector<std::string> files;
+        cv::glob(path, files, false);
+        std::sort(files.begin(), files.end());
+
+        for (const auto& file : files) {
+            toGray(cv::imread(file, cv::IMREAD_GRAYSCALE), frames);
+        }
+
+        return frames;
+    }
+
+    // raw files are 8 bit grayscale frames stored back to back
+    std::vector<cv::Mat> loadRaw(const std::string& path, int width, int height)
+    {
+        std::vector<cv::Mat> frames;
+        std::ifstream file(path, std::ios::binary);
+
+        if (width <= 0 || height <= 0)
+            return frames;
+
+        while (file) {
+            cv::Mat frame(height, width, CV_8UC1);
+            file.read(reinterpret_cast<char*>(frame.data), width * height);
+
+            if (file.gcount() != width * height)
+                break;
+
+            frames.push_back(frame);
+        }
+
+        return frames;
+    }
+
+    double toMs(Clock::duration d)
+    {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+    double percentile(std::vector<double> sorted_values, double p)
+    {
+        if (sorted_values.empty())
+            return 0.0;
+
+        size_t index = std::min(sorted_values.size() - 1, size_t(p * (sorted_values.size() - 1) + 0.5));
+        return sorted_values[index];
+    }
+
+    void printUsage()
+    {
+        std::cout << "usage: detector2DBenchmark (--video file | --dir directory | --raw file --width w --height h)"
+                  << " [--roi x,y,width,height] [--repeat n] [--warmup n] [--tracking 0|1] [--pyramid 0|1]" << std::endl;
+    }
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    std::string video, directory, raw;
+    int width = 0, height = 0;
+    int repeat = 1;
+    int warmup = 10;
+    cv::Rect roi;
+    bool has_roi = false;
+    bool tracking = false;
+    bool pyramid = false;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        std::string value = argv[i + 1];
+
+        if (arg == "--video") video = value;
+        else if (arg == "--dir") directory = value;
+        else if (arg == "--raw") raw = value;
+        else if (arg == "--width") width = std::atoi(value.c_str());
+        else if (arg == "--height") height = std::atoi(value.c_str());
+        else if (arg == "--repeat") repeat = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--warmup") warmup = std::max(0, std::atoi(value.c_str()));
+        else if (arg == "--tracking") tracking = std::atoi(value.c_str()) != 0;
+        else if (arg == "--pyramid") pyramid = std::atoi(value.c_str()) != 0;
+        else if (arg == "--roi") {
+            has_roi = std::sscanf(value.c_str(), "%d,%d,%d,%d", &roi.x, &roi.y, &roi.width, &roi.height) == 4;
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::vector<cv::Mat> frames;
+
+    if (!video.empty()) frames = loadVideo(video);
+    else if (!directory.empty()) frames = loadDirectory(directory);
+    else if (!raw.empty()) frames = loadRaw(raw, width, height);
+
+    if (frames.empty()) {
+        printUsage();
+        std::cout << "No frames loaded." << std::endl;
+        return 1;
+    }
+
+    const cv::Rect frame_rect(0, 0, frames[0].cols, frames[0].rows);
+    roi = has_roi ? (roi & frame_rect) : frame_rect;
+
+    Detector2DProperties props = defaultProperties();
+    props.tracking = tracking;
+    props.pyramid_detection = pyramid;
+    Detector2D detector;
+    cv::Mat color_image, debug_image;
+
+    auto run = [&](cv::Mat & frame) {
+        cv::Rect frame_roi = roi;
+        return detector.detect(props, frame, color_image, debug_image, frame_roi, false, false, false);
+    };
+
+    for (int i = 0; i < warmup; i++) {
+        run(frames[i % frames.size()]);
+    }
+
+    std::vector<double> latencies;
+    latencies.reserve(frames.size() * repeat);
+    Detector2DTimings stage_totals;
+    double confidence_sum = 0.0;
+    const Clock::time_point benchmark_start = Clock::now();
+
+    for (int r = 0; r < repeat; r++) {
+        for (auto& frame : frames) {
+            const Clock::time_point start = Clock::now();
+            auto result = run(frame);
+            latencies.push_back(toMs(Clock::now() - start));
+            confidence_sum += result->confidence;
+
+            const Detector2DTimings& stages = result->timings;
+            stage_totals.histogram += stages.histogram;
+            stage_totals.masks += stages.masks;
+            stage_totals.morphology_open += stages.morphology_open;
+            stage_totals.median_blur += stages.median_blur;
+            stage_totals.canny += stages.canny;
+            stage_totals.find_contours += stages.find_contours;
+            stage_totals.split_contours += stages.split_contours;
+            stage_totals.divide_contours += stages.divide_contours;
+            stage_totals.combinatorial_search += stages.combinatorial_search;
+            stage_totals.final_fitting += stages.final_fitting;
+        }
+    }
+
+    const double total_ms = toMs(Clock::now() - benchmark_start);
+    const double n = latencies.size();
+    std::sort(latencies.begin(), latencies.end());
+
+    std::printf("frames:          %d (%dx%d, roi %dx%d)\n", int(n), frame_rect.width, frame_rect.height, roi.width, roi.height);
+    std::printf("frames/s:        %.1f\n", n / (total_ms / 1000.0));
+    std::printf("latency p50:     %.3f ms\n", percentile(latencies, 0.5));
+    std::printf("latency p99:     %.3f ms\n", percentile(latencies, 0.99));
+    std::printf("latency max:     %.3f ms\n", latencies.back());
+    std::printf("mean confidence: %.3f\n", confidence_sum / n);
+    std::printf("\nmean time per stage:\n");
+
+    const std::pair<const char*, Clock::rep> stages[] = {
+        {"histogram", stage_totals.histogram},
+        {"masks", stage_totals.masks},
+        {"morphology open", stage_totals.morphology_open},
+        {"median blur", stage_totals.median_blur},
+        {"canny", stage_totals.canny},
+        {"find contours", stage_totals.find_contours},
+        {"split contours", stage_totals.split_contours},
+        {"divide contours", stage_totals.divide_contours},
+        {"combinatorial search", stage_totals.combinatorial_search},
+        {"final fitting", stage_totals.final_fitting}
+    };
+    double stage_sum_ms = 0.0;
+
+    for (const auto& stage : stages) {
+        stage_sum_ms += ticksToMilliseconds(stage.second);
+    }
+
+    for (const auto& stage : stages) {
+        const double ms = ticksToMilliseconds(stage.second);
+        std::printf("  %-22s %8.3f ms  %5.1f %%\n", stage.first, ms / n, stage_sum_ms > 0.0 ? 100.0 * ms / stage_sum_ms : 0.0);
+    }
+
+    return 0;
+}
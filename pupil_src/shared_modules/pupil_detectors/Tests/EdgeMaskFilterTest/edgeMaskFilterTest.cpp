@@ -0,0 +1,74 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// Compares EdgeMaskFilter with the inRange, dilate, erode and min chain it replaces in Detector2D,
+// on random images and edge maps. The results have to be identical.
+
+#include <iostream>
+#include <random>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "ImageProcessing/EdgeMaskFilter.h"
+
+
+using namespace singleeyefitter;
+
+int main()
+{
+    std::cout << "Start Test" << std::endl;
+
+    std::mt19937 generator(42);
+    const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, {7, 7});
+    EdgeMaskFilter filter(kernel);
+    const int tests = 500;
+    int failed = 0;
+
+    for (int t = 0; t < tests; t++) {
+        const int width = 1 + generator() % 200;
+        const int height = 1 + generator() % 200;
+
+        // dark and bright blobs on noise, so the masks have borders
+        cv::Mat image(height, width, CV_8UC1);
+        cv::randu(image, 0, 256);
+
+        for (int b = 0; b < 6; b++) {
+            const cv::Point center(generator() % width, generator() % height);
+            cv::circle(image, center, generator() % 30, cv::Scalar(generator() % 256), -1);
+        }
+
+        cv::Mat edges(height, width, CV_8UC1);
+        cv::randu(edges, 0, 2);
+        edges *= 255;
+
+        // thresholds as in Detector2D, they can be outside of the pixel range
+        const int dark_threshold = int(generator() % 100) + 23;
+        const int spectral_threshold = int(generator() % 260) - 5;
+
+        cv::Mat dark, spectral, expected;
+        cv::inRange(image, cv::Scalar(0) , cv::Scalar(dark_threshold), dark);
+        cv::dilate(dark, dark, kernel, { -1, -1}, 2);
+        cv::inRange(image, cv::Scalar(0) , cv::Scalar(spectral_threshold), spectral);
+        cv::erode(spectral, spectral, kernel);
+        cv::min(edges, spectral, expected);
+        cv::min(expected, dark, expected);
+
+        cv::Mat dark_mask, spectral_mask;
+        filter.apply(image, edges, dark_threshold, spectral_threshold, &dark_mask, &spectral_mask);
+
+        if (cv::countNonZero(edges != expected) || cv::countNonZero(dark_mask != dark) || cv::countNonZero(spectral_mask != spectral))
+            failed++;
+    }
+
+    std::cout << "different results: " << failed << " of " << tests << std::endl;
+    std::cout << (failed == 0 ? "PASSED" : "FAILED") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,22 @@
+"""
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+"""
+
+if __name__ == "__main__":
+    import subprocess as sp
+
+    sp.call(
+        "g++ -std=c++11 -D_USE_MATH_DEFINES -I '/usr/local/include/eigen3' -I '../../../../shared_cpp/include' -I '../../singleeyefitter' "
+        "-g edgePixelIndexTest.cpp -o test `pkg-config --cflags --libs opencv4 || pkg-config --cflags --libs opencv`",
+        shell=True,
+    )
+    print("BUILD COMPLETE ______________________")
+    sp.call("./test", shell=True)
+    sp.call("rm test", shell=True)
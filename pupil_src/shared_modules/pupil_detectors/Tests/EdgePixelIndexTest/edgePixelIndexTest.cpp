@@ -0,0 +1,149 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// Compares the support pixels of EdgePixelIndex with a support mask of the edge image.
+//
+// The contours are found and approximated like the 2D detector does on the eye videos of the tests. Their support
+// is the edge image masked with the contours drawn with cv::polylines and a thickness of 2, as the detector did before
+// it used the index. Single contours, groups of contours and excluded pixels have to give exactly the same pixels in the
+// same order. The videos can be given as arguments, by default the recordings in video_capture/tests/data are used.
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "ImageProcessing/EdgePixelIndex.h"
+#include "common/types.h"
+
+
+using namespace singleeyefitter;
+
+namespace {
+
+    // edges with the default settings of the 2D detector
+    void findEdges(const cv::Mat& frame, cv::Mat& edges)
+    {
+        cv::Mat gray, blurred;
+
+        if (frame.channels() == 3)
+            cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+        else
+            gray = frame;
+
+        cv::medianBlur(gray, blurred, 5);
+        cv::Canny(blurred, edges, 160, 160 * 2, 5);
+    }
+
+    // the support of the polylines like the detector computed it before the index
+    void maskSupport(const cv::Mat& edges, const Contours_2D& polylines, std::vector<cv::Point>& support)
+    {
+        cv::Mat support_mask(edges.rows, edges.cols, edges.type(), {0, 0, 0});
+        cv::polylines(support_mask, polylines, false, {255, 255, 255}, 2);
+        cv::Mat new_edges;
+        cv::bitwise_and(edges, support_mask, new_edges);
+        support.clear();
+        cv::findNonZero(new_edges, support);
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::cout << "Start Test" << std::endl;
+
+    std::vector<std::string> videos(argv + 1, argv + argc);
+
+    if (videos.empty()) {
+        videos = {"../../../video_capture/tests/data/single/eye0.mp4", "../../../video_capture/tests/data/multiple/eye0_001.mp4"};
+    }
+
+    int frames = 0, queries = 0, different = 0;
+    size_t support_pixels = 0;
+    EdgePixelIndex index;
+
+    for (const auto& video : videos) {
+        cv::VideoCapture capture(video);
+        cv::Mat frame;
+
+        while (capture.isOpened() && capture.read(frame)) {
+            frames++;
+            cv::Mat edges;
+            findEdges(frame, edges);
+
+            std::vector<cv::Point> raw_edges;
+            cv::findNonZero(edges, raw_edges);
+            index.build(raw_edges, edges.size());
+
+            Contours_2D contours, polylines;
+            cv::findContours(edges.clone(), contours, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+
+            for (const auto& contour : contours) {
+                if (contour.size() <= 60) continue;
+
+                polylines.emplace_back();
+                cv::approxPolyDP(contour, polylines.back(), 1.5, false);
+            }
+
+            std::vector<cv::Point> support, reference;
+
+            auto compare = [&](const Contours_2D & query_polylines) {
+                maskSupport(edges, query_polylines, reference);
+                queries++;
+                support_pixels += reference.size();
+
+                if (support != reference) different++;
+            };
+
+            // every contour on its own, like resolving the contours of a solution
+            for (const auto& polyline : polylines) {
+                index.query(polyline, support);
+                compare({polyline});
+            }
+
+            // every other contour at once, like the final fit on the best solution
+            std::vector<int> indices;
+            Contours_2D selected;
+
+            for (size_t i = 0; i < polylines.size(); i += 2) {
+                indices.push_back(int(i));
+                selected.push_back(polylines[i]);
+            }
+
+            index.query(polylines, indices, support);
+            compare(selected);
+            index.query(polylines, support);
+            compare(polylines);
+
+            // an excluded pixel is missing from the support, like the pixel cvx::findNonZero adds
+            if (!raw_edges.empty() && !polylines.empty()) {
+                const cv::Point excluded = raw_edges[raw_edges.size() / 2];
+                index.exclude(raw_edges.size() / 2);
+                index.query(polylines, support);
+                maskSupport(edges, polylines, reference);
+                reference.erase(std::remove(reference.begin(), reference.end(), excluded), reference.end());
+                queries++;
+
+                if (support != reference) different++;
+            }
+        }
+    }
+
+    std::cout << "frames: " << frames << ", queries: " << queries << ", support pixels: " << support_pixels
+              << ", different supports: " << different << std::endl;
+
+    const bool passed = frames > 0 && queries > frames && support_pixels > 0 && different == 0;
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
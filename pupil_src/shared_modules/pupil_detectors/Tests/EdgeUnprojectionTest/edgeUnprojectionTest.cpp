@@ -0,0 +1,75 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// Compares the batch unprojection of EdgeUnprojection with intersecting every camera ray with the sphere,
+// like EyeModelFitter::unprojectEdges did, for image points on and around the projected sphere.
+// The batches change their size, after the largest one the buffers must not be reallocated.
+
+#include <iostream>
+#include <random>
+
+#include "EdgeUnprojection.h"
+#include "math/intersect.h"
+
+
+using namespace singleeyefitter;
+
+int main()
+{
+    std::cout << "Start Test" << std::endl;
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> pixel(-240, 240);
+    const double focalLength = 620;
+    EdgeUnprojection unprojection;
+    int failed = 0, total = 0, hits = 0, reallocated = 0;
+    const double* buffer = nullptr;
+
+    for (int trial = 0; trial < 100; trial++) {
+        const Vector3 cameraCenter = trial % 2 ? Vector3(0, 0, 0) : Vector3(1, -2, 0.5);
+        const Sphere<double> sphere(Vector3(pixel(generator) / 40.0, pixel(generator) / 40.0, 30 + trial % 20), 12);
+        Edges2D edges;
+
+        const int count = trial == 0 ? 3000 : trial % 3 ? 200 + 10 * trial : 2000 - trial;
+
+        for (int i = 0; i < count; i++) {
+            edges.emplace_back(pixel(generator), pixel(generator));
+        }
+
+        unprojection.unproject(edges, cameraCenter, focalLength, sphere);
+
+        if (trial == 0)
+            buffer = unprojection.x().data();
+        else if (unprojection.x().data() != buffer)
+            reallocated++;
+
+        if (unprojection.size() != count || unprojection.valid().size() != count)
+            failed++;
+
+        for (int i = 0; i < count; i++) {
+            const Vector3 direction = Vector3(edges[i].x, edges[i].y, focalLength) - cameraCenter;
+            std::pair<Vector3, Vector3> points;
+            const bool didIntersect = intersect(Line3(cameraCenter, direction.normalized()), sphere, points);
+            const Vector3 point(unprojection.x()[i], unprojection.y()[i], unprojection.z()[i]);
+            total++;
+            hits += didIntersect;
+
+            if (didIntersect != unprojection.valid()[i] || (didIntersect && (point - points.first).norm() > 1e-9)) {
+                failed++;
+            }
+        }
+    }
+
+    const bool passed = failed == 0 && reallocated == 0;
+    std::cout << "failed: " << failed << " of " << total << " (" << hits << " on the sphere), reallocated: " << reallocated << std::endl;
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,26 @@
+"""
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+"""
+
+if __name__ == "__main__":
+    import subprocess as sp
+
+    # once for the default instruction set and once for the AVX2 kernel
+    for flags in ("", "-mavx2"):
+        sp.call(
+            "g++ -std=c++11 -D_USE_MATH_DEFINES -O2 {} -I '/usr/local/include/eigen3' -I '../../../../shared_cpp/include' -I '../../singleeyefitter' "
+            "ellipseDistanceBatchTest.cpp -o test `pkg-config --cflags --libs opencv4 || pkg-config --cflags --libs opencv`".format(
+                flags
+            ),
+            shell=True,
+        )
+        print("BUILD COMPLETE ______________________")
+        sp.call("./test", shell=True)
+        sp.call("rm test", shell=True)
@@ -0,0 +1,121 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// Compares EllipseDistCalculator::batch with the distances of operator() for single points.
+//
+// The point counts are not multiples of the 2 or 4 lanes of the SSE2 and AVX2 kernels, so the scalar tail is covered
+// as well, and the points are read from a std::vector<cv::Point> with a stride of 2. Circles with an integer center and
+// radius give exact distances, which puts points exactly on the threshold. The distances and the inlier count have to
+// be the same as the ones of operator(), the squared sum is only summed in another order.
+// The test is built once for the instruction set the compiler targets by default and once with -mavx2.
+
+#include <iostream>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "common/types.h"
+#include "EllipseDistanceApproxCalculator.h"
+
+
+using namespace singleeyefitter;
+
+int main()
+{
+    std::cout << "Start Test" << std::endl;
+
+#if defined(SINGLEEYEFITTER_ELLIPSE_DISTANCE_AVX2)
+    std::cout << "kernel: AVX2" << std::endl;
+#if defined(__GNUC__)
+    if (!__builtin_cpu_supports("avx2")) {
+        std::cout << "the cpu doesn't support AVX2, skipped" << std::endl << "PASSED" << std::endl;
+        return 0;
+    }
+#endif
+#elif defined(SINGLEEYEFITTER_ELLIPSE_DISTANCE_SSE2)
+    std::cout << "kernel: SSE2" << std::endl;
+#else
+    std::cout << "kernel: scalar" << std::endl;
+#endif
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> angle(0.0, M_PI);
+    std::uniform_real_distribution<double> radius(5.0, 40.0);
+    std::uniform_int_distribution<int> coordinate(0, 100);
+
+    int cases = 0, failed = 0, thresholdPoints = 0;
+    double maxSumError = 0.0;
+
+    auto compare = [&](const Ellipse2D<double>& ellipse, const std::vector<cv::Point>& points, double threshold) {
+        EllipseDistCalculator<double> calculator(ellipse);
+        EllipseDistCalculator<double> reference(ellipse);
+        std::vector<double> distances(points.size(), 0.0);
+        const auto batch = calculator.batch(points, threshold, distances.data());
+        const auto counted = calculator.batch(points, threshold);
+
+        double sum = 0.0;
+        size_t inliers = 0;
+        bool same = true;
+
+        for (size_t i = 0; i < points.size(); i++) {
+            const double d = reference((double)points[i].x, (double)points[i].y);
+            sum += d * d;
+
+            if (std::abs(d) <= threshold) inliers++;
+            if (std::abs(d) == threshold) thresholdPoints++;
+            if (distances[i] != d) same = false;
+        }
+
+        const double sumError = std::abs(batch.squared_sum - sum) / std::max(1.0, sum);
+        maxSumError = std::max(maxSumError, sumError);
+        cases++;
+
+        if (!same || batch.inlier_count != inliers || counted.inlier_count != inliers || counted.squared_sum != batch.squared_sum || sumError > 1e-12)
+            failed++;
+    };
+
+    // circles around (50, 50) with a radius of 5, the points on circles with the radii of pythagorean triples have the
+    // exact distances 5, 0, 2, -2, -5, -8 and -10, a threshold of 2 or 5 puts some of them exactly on it
+    const Ellipse2D<double> circle(Vector2(50.0, 50.0), 5.0, 5.0, 0.0);
+    const std::vector<cv::Point> exact = {{50, 50}, {53, 54}, {47, 54}, {53, 50}, {57, 50}, {50, 60}, {56, 58}, {50, 37},
+                                          {45, 38}, {55, 50}, {50, 43}, {41, 38}, {50, 63}};
+
+    for (size_t count = 0; count <= exact.size(); count++) {
+        const std::vector<cv::Point> points(exact.begin(), exact.begin() + count);
+
+        for (double threshold : {0.0, 2.0, 5.0}) {
+            compare(circle, points, threshold);
+        }
+    }
+
+    // rotated ellipses with a threshold equal to the distance of one of the points
+    for (int round = 0; round < 200; round++) {
+        const double major = radius(generator);
+        const Ellipse2D<double> ellipse(Vector2(coordinate(generator), coordinate(generator)), major, major * 0.6, angle(generator));
+        std::vector<cv::Point> points(1 + round % 23);
+
+        for (auto& p : points) {
+            p = cv::Point(coordinate(generator), coordinate(generator));
+        }
+
+        EllipseDistCalculator<double> calculator(ellipse);
+        const cv::Point& on_threshold = points[round % points.size()];
+        compare(ellipse, points, std::abs(calculator((double)on_threshold.x, (double)on_threshold.y)));
+    }
+
+    std::cout << "cases: " << cases << ", failed: " << failed << ", points on the threshold: " << thresholdPoints
+              << ", max relative error of the squared sum: " << maxSumError << std::endl;
+
+    const bool passed = failed == 0 && thresholdPoints > 0;
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// Validates EllipseFitter2D on the contours of the eye videos of the tests, found like the 2D detector does.
+//
+// Every contour is fitted as a whole and as the sum of the scatter matrices of three pieces, which has to give
+// the same ellipse. The fit is compared with cv::fitEllipseDirect, which solves the same problem, and with
+// cv::fitEllipse on the contours which lie on an ellipse like the contours of a pupil. The videos can be given
+// as arguments, by default the recordings in video_capture/tests/data are used.
+
+#include <iostream>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "Fit/EllipseFit2D.h"
+#include "common/types.h"
+
+
+using namespace singleeyefitter;
+
+namespace {
+
+    // size.height is the major axis, like cv::fitEllipse reports it
+    cv::RotatedRect normalized(cv::RotatedRect ellipse)
+    {
+        if (ellipse.size.width > ellipse.size.height) {
+            std::swap(ellipse.size.width, ellipse.size.height);
+            ellipse.angle += 90.0f;
+        }
+
+        return ellipse;
+    }
+
+    struct Difference {
+        double center = 0.0, axes = 0.0, angle = 0.0;
+        int count = 0;
+
+        void add(const cv::RotatedRect& fitted_ellipse, const cv::RotatedRect& reference_ellipse)
+        {
+            const cv::RotatedRect fitted = normalized(fitted_ellipse);
+            const cv::RotatedRect reference = normalized(reference_ellipse);
+            count++;
+            center = std::max(center, std::hypot(double(fitted.center.x - reference.center.x), double(fitted.center.y - reference.center.y)));
+            axes = std::max(axes, std::max(std::abs(fitted.size.height - reference.size.height),
+                                           std::abs(fitted.size.width - reference.size.width)) / double(reference.size.height));
+
+            // the angle of almost round ellipses is not defined
+            if (reference.size.width < 0.9 * reference.size.height) {
+                double difference = std::fmod(std::abs(fitted.angle - reference.angle), 180.0);
+                angle = std::max(angle, std::min(difference, 180.0 - difference));
+            }
+        }
+
+        bool within(double max_center, double max_axes, double max_angle) const
+        {
+            return center < max_center && axes < max_axes && angle < max_angle;
+        }
+
+        void print(const std::string& name) const
+        {
+            std::cout << name << ": " << count << " contours, max center difference " << center << " px, max relative axis difference "
+                      << axes << ", max angle difference " << angle << " deg" << std::endl;
+        }
+    };
+
+    // edges and contours with the default settings of the 2D detector
+    void findContours(const cv::Mat& frame, Contours_2D& contours)
+    {
+        cv::Mat gray, blurred, edges;
+
+        if (frame.channels() == 3)
+            cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+        else
+            gray = frame;
+
+        cv::medianBlur(gray, blurred, 5);
+        cv::Canny(blurred, edges, 160, 160 * 2, 5);
+        cv::findContours(edges, contours, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+    }
+
+    // largest distance of the points to the ellipse, approximated with a polygon of the ellipse
+    double maxDistance(const std::vector<cv::Point>& points, const cv::RotatedRect& ellipse)
+    {
+        std::vector<cv::Point2f> polygon;
+        std::vector<cv::Point> integer_polygon;
+        cv::ellipse2Poly(cv::Point(ellipse.center), cv::Size(ellipse.size.width / 2, ellipse.size.height / 2), int(std::round(ellipse.angle)), 0, 360, 1, integer_polygon);
+
+        for (const auto& p : integer_polygon) polygon.emplace_back(p);
+
+        double distance = 0.0;
+
+        for (const auto& p : points) {
+            distance = std::max(distance, std::abs(cv::pointPolygonTest(polygon, cv::Point2f(p), true)));
+        }
+
+        return distance;
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::cout << "Start Test" << std::endl;
+
+    std::vector<std::string> videos(argv + 1, argv + argc);
+
+    if (videos.empty()) {
+        videos = {"../../../video_capture/tests/data/single/eye0.mp4", "../../../video_capture/tests/data/multiple/eye0_001.mp4"};
+    }
+
+    Difference pieces, direct, reference;
+    int failed = 0;
+    int frames = 0;
+
+    for (const auto& video : videos) {
+        cv::VideoCapture capture(video);
+        cv::Mat frame;
+
+        while (capture.isOpened() && capture.read(frame)) {
+            frames++;
+            const EllipseFitter2D fitter(cv::Point2d(frame.cols / 2.0, frame.rows / 2.0), std::max(frame.cols, frame.rows) / 2.0);
+            const cv::Rect bounds(0, 0, frame.cols, frame.rows);
+            Contours_2D contours;
+            findContours(frame, contours);
+
+            for (const auto& contour : contours) {
+                // the fits of short contours are dominated by the pixel rounding
+                if (contour.size() < 20)
+                    continue;
+
+                // the sum of the scatter matrices of the pieces has to describe the same points
+                EllipseFitter2D::Scatter scatter = EllipseFitter2D::Scatter::Zero();
+                const size_t third = contour.size() / 3;
+                fitter.addPoints(std::vector<cv::Point>(contour.begin(), contour.begin() + third), scatter);
+                fitter.addPoints(std::vector<cv::Point>(contour.begin() + third, contour.begin() + 2 * third), scatter);
+                fitter.addPoints(std::vector<cv::Point>(contour.begin() + 2 * third, contour.end()), scatter);
+
+                cv::RotatedRect fitted, fitted_pieces;
+                const bool fit = fitter.fit(fitter.scatter(contour), fitted);
+
+                if (fit != fitter.fit(scatter, fitted_pieces)) {
+                    failed++;
+                    continue;
+                }
+
+                // degenerated point sets are left to opencv by the detector
+                if (!fit)
+                    continue;
+
+                // only plausible pupil candidates matter, the fits of almost straight contours are arbitrary
+                const cv::Rect box = fitted.boundingRect();
+                if ((box & bounds) != box || fitted.size.width < 0.2 * fitted.size.height)
+                    continue;
+
+                pieces.add(fitted_pieces, fitted);
+                direct.add(fitted, cv::fitEllipseDirect(contour));
+
+                // opencv minimizes a different error, the fits only agree if the points lie on an ellipse
+                const cv::RotatedRect cv_ellipse = cv::fitEllipse(contour);
+                if (maxDistance(contour, cv_ellipse) < 1.5)
+                    reference.add(fitted, cv_ellipse);
+            }
+        }
+    }
+
+    std::cout << "frames: " << frames << ", failed fits: " << failed << std::endl;
+    pieces.print("pieces vs whole contour ");
+    direct.print("cv::fitEllipseDirect    ");
+    reference.print("cv::fitEllipse          ");
+
+    const bool passed = frames > 0 && failed == 0 && reference.count > 0 &&
+                        pieces.within(1e-3, 1e-4, 0.01) &&
+                        direct.within(0.01, 1e-3, 0.1) &&
+                        reference.within(0.5, 0.02, 2.0);
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// Runs the circle search of EyeModelFitter::filterCircle3 on synthetic edges of pupils on the sphere, with noise,
+// on a thread pool and without one. Both have to score every cell the same and find the same circle, near the pupil.
+
+#include <iostream>
+#include <random>
+
+#include "GridSearch.h"
+#include "SphericalEdgeIndex.h"
+#include "mathHelper.h"
+
+
+using namespace singleeyefitter;
+
+namespace {
+
+    const Vector3 sphereCenter(1, 2, 40);
+    const double sphereRadius = 12;
+    const double focalLength = 620;
+
+    struct Search {
+        std::vector<int> edgeCounts;
+        std::vector<double> accRadii;
+        size_t best = 0;
+        bool found = false;
+        Vector3 center;
+    };
+
+    // one pass of filterCircle3 around searchCenter
+    Search search(const Edges3D& edges, const Vector3& searchCenter, double pupilSphereRadius, double positionVariance,
+                  double searchStep, int bandWidthPixel, ThreadPool* pool)
+    {
+        const Vector2 predicted = math::cart2sph(Vector3(searchCenter - sphereCenter));
+        SphericalEdgeIndex edgeIndex;
+        edgeIndex.build(sphereCenter, sphereRadius, edges, std::max(searchStep, pupilSphereRadius / sphereRadius / 4.0), predicted.y());
+
+        const auto pupilCenter = [&](double theta, double psi) -> Vector3 {
+            return sphereCenter + math::sph2cart(sphereRadius, theta, psi);
+        };
+
+        const auto score = [&](double theta, double psi, int& edgeCount, double& accRadius) {
+            const Vector3 center = pupilCenter(theta, psi);
+            const double bandWidthHalf = bandWidthPixel * center.z() / focalLength / 2.0;
+            edgeIndex.countBand(center, std::pow(pupilSphereRadius - bandWidthHalf, 2), std::pow(pupilSphereRadius + bandWidthHalf, 2), edgeCount, accRadius);
+        };
+
+        const std::vector<double> thetas = searchAngles(predicted.x() - positionVariance, predicted.x() + positionVariance, searchStep);
+        const std::vector<double> psis = searchAngles(predicted.y() - positionVariance, predicted.y() + positionVariance, searchStep);
+        Search result;
+        result.found = searchGrid(thetas, psis, pool, score, result.edgeCounts, result.accRadii, result.best);
+        result.center = result.found ? pupilCenter(thetas[result.best / psis.size()], psis[result.best % psis.size()]) : searchCenter;
+        return result;
+    }
+
+    bool same(const Search& a, const Search& b)
+    {
+        return a.found == b.found && a.best == b.best && a.edgeCounts == b.edgeCounts && a.accRadii == b.accRadii;
+    }
+
+} // namespace
+
+int main()
+{
+    std::cout << "Start Test" << std::endl;
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::normal_distribution<double> noise(0.0, 0.02);
+    ThreadPool pool(4);
+    int failed = 0, missed = 0;
+    const int trials = 50;
+
+    for (int trial = 0; trial < trials; trial++) {
+        // the pupil faces the camera more or less
+        const double theta = constants::PI / 2 + 0.4 * uniform(generator);
+        const double psi = -constants::PI / 2 + 0.4 * uniform(generator);
+        const double pupilRadius = 1.5 + 0.5 * uniform(generator);
+        const Vector3 normal = math::sph2cart(1.0, theta, psi);
+        const Vector3 pupil = sphereCenter + sphereRadius * normal;
+        const Vector3 u = normal.unitOrthogonal();
+        const Vector3 v = normal.cross(u);
+
+        // edges of the pupil border and spread around it, both on the sphere
+        const double h = sphereRadius - std::sqrt(sphereRadius * sphereRadius - pupilRadius * pupilRadius);
+        const double pupilSphereRadius = std::sqrt(2.0 * sphereRadius * h);
+        Edges3D edges;
+
+        for (int i = 0; i < 300; i++) {
+            const double angle = constants::PI * uniform(generator);
+            const Vector3 border = sphereCenter + normal * (sphereRadius - h) + pupilRadius * (std::cos(angle) * u + std::sin(angle) * v);
+            edges.push_back(sphereCenter + sphereRadius * (border + Vector3(noise(generator), noise(generator), noise(generator)) - sphereCenter).normalized());
+        }
+
+        for (int i = 0; i < 300; i++) {
+            edges.push_back(sphereCenter + math::sph2cart(sphereRadius, theta + 0.3 * uniform(generator), psi + 0.3 * uniform(generator)));
+        }
+
+        // coarse and fine pass like filterCircle3, from a prediction off the pupil
+        const Vector3 predicted = sphereCenter + math::sph2cart(sphereRadius, theta + 0.1 * uniform(generator), psi + 0.1 * uniform(generator));
+        const Search coarse = search(edges, predicted, pupilSphereRadius, 0.2, 0.05, 6, &pool);
+        const Search coarseSerial = search(edges, predicted, pupilSphereRadius, 0.2, 0.05, 6, nullptr);
+        const Search fine = search(edges, coarse.center, pupilSphereRadius, 0.05, 0.01, 2, &pool);
+        const Search fineSerial = search(edges, coarseSerial.center, pupilSphereRadius, 0.05, 0.01, 2, nullptr);
+
+        if (!same(coarse, coarseSerial) || !same(fine, fineSerial)) failed++;
+        if (!fine.found || (fine.center - pupil).norm() > 0.2) missed++;
+    }
+
+    const bool passed = failed == 0 && missed <= trials / 10;
+    std::cout << "different from serial: " << failed << " of " << trials << ", pupil missed: " << missed << std::endl;
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// Compares the fixed size KalmanFilter with the update equations of cv::KalmanFilter on dynamic matrices,
+// for the pupil state model of EyeModelFitter, and predictAhead with repeated predictions.
+
+#include <iostream>
+#include <random>
+
+#include <Eigen/Dense>
+
+#include "KalmanFilter.h"
+
+
+using namespace singleeyefitter;
+
+typedef KalmanFilter<double, 7, 3> Filter;
+
+Filter::StateMatrix transition(double dt)
+{
+    Filter::StateMatrix F;
+    F << 1, 0, dt, 0, 0.5 * dt * dt, 0, 0,
+         0, 1, 0, dt, 0, 0.5 * dt * dt, 0,
+         0, 0, 1, 0, dt, 0, 0,
+         0, 0, 0, 1, 0, dt, 0,
+         0, 0, 0, 0, 1, 0, 0,
+         0, 0, 0, 0, 0, 1, 0,
+         0, 0, 0, 0, 0, 0, 1;
+    return F;
+}
+
+int main()
+{
+    std::cout << "Start Test" << std::endl;
+
+    std::mt19937 generator(42);
+    std::normal_distribution<double> noise(0.0, 0.01);
+
+    Filter filter;
+    filter.measurementMatrix << 1, 0, 0, 0, 0, 0, 0,
+                                0, 1, 0, 0, 0, 0, 0,
+                                0, 0, 0, 0, 0, 0, 1;
+    filter.processNoiseCov *= 1e-4;
+    filter.measurementNoiseCov *= 1e-5;
+    filter.measurementNoiseCov(2, 2) = 0.1;
+    filter.state(6) = 2.0;
+
+    Eigen::MatrixXd H = filter.measurementMatrix, Q = filter.processNoiseCov, R = filter.measurementNoiseCov;
+    Eigen::VectorXd x = filter.state;
+    Eigen::MatrixXd P = filter.errorCov;
+    double maxError = 0.0;
+
+    for (int frame = 0; frame < 500; frame++) {
+        const double dt = 1.0 / (30 + frame % 90);
+        const Eigen::MatrixXd F = transition(dt);
+
+        filter.predict(transition(dt));
+        x = F * x;
+        P = F * P * F.transpose() + Q;
+
+        if (frame % 5 != 4) {
+            const double t = frame / 60.0;
+            const Filter::Measurement z(std::sin(t) + noise(generator), std::cos(t) + noise(generator), 2.5 + noise(generator));
+            filter.correct(z);
+
+            const Eigen::MatrixXd K = P * H.transpose() * (H * P * H.transpose() + R).inverse();
+            x = x + K * (Eigen::VectorXd(z) - H * x);
+            P = P - K * H * P;
+        }
+
+        maxError = std::max(maxError, (filter.state - x).cwiseAbs().maxCoeff());
+        maxError = std::max(maxError, (filter.errorCov - P).cwiseAbs().maxCoeff());
+    }
+
+    const Filter::StateMatrix F = transition(1.0 / 120);
+    const Filter::State before = filter.state;
+    const Eigen::Matrix<double, 7, 4> ahead = filter.predictAhead<4>(F);
+    const bool unchanged = filter.state == before;
+
+    for (int i = 0; i < 4; i++) {
+        filter.predict(F);
+        maxError = std::max(maxError, (ahead.col(i) - filter.state).cwiseAbs().maxCoeff());
+    }
+
+    const bool passed = maxError < 1e-9 && unchanged;
+
+    std::cout << "max error: " << maxError << std::endl;
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// The executor has to respect the concurrency limit, never run two jobs of one owner at the same time,
+// replace pending jobs of an owner and run nothing of an owner after cancel returned. Its own workers have to
+// follow a raised limit.
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "RefinementExecutor.h"
+
+int main()
+{
+    std::cout << "Start Test" << std::endl;
+
+    using namespace singleeyefitter;
+    const int owners = 4;
+    std::atomic<int> running(0), maxRunning(0), jobs(0);
+    std::vector<std::atomic<int>> runningPerOwner(owners);
+    std::vector<std::atomic<bool>> cancelled(owners);
+    std::atomic<bool> passed(true);
+    for (auto& r : runningPerOwner) r = 0;
+    for (auto& c : cancelled) c = false;
+
+    {
+        RefinementExecutor executor(2);
+        executor.setThreadPool(std::make_shared<ThreadPool>(4));
+
+        for (int round = 0; round < 200; round++) {
+            for (int o = 0; o < owners; o++) {
+                if (cancelled[o]) continue;
+
+                executor.submit(&runningPerOwner[o], [&, o]() {
+                    const int now = ++running;
+                    for (int m = maxRunning; now > m && !maxRunning.compare_exchange_weak(m, now);) {}
+
+                    if (++runningPerOwner[o] != 1 || cancelled[o]) passed = false;
+
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                    runningPerOwner[o]--;
+                    running--;
+                    jobs++;
+                });
+            }
+
+            if (round == 100) {
+                executor.cancel(&runningPerOwner[0]);
+                cancelled[0] = true;
+            }
+
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+
+        // the pending jobs would run under the higher limit below
+        for (int o = 1; o < owners; o++) executor.cancel(&runningPerOwner[o]);
+
+        // without a pool of the caller the executor uses workers of its own
+        executor.setThreadPool(nullptr);
+        executor.setMaxConcurrency(3);
+        std::atomic<int> ownJobs(0);
+        for (int o = 1; o < owners; o++) executor.submit(&runningPerOwner[o], [&]() { ownJobs++; });
+        for (int o = 1; o < owners; o++) executor.cancel(&runningPerOwner[o]);
+        if (ownJobs > owners - 1) passed = false;
+    }
+
+    // the own workers follow the limit, also when it is raised while they run
+    std::atomic<int> ownRunning(0), ownMaxRunning(0), ownDone(0);
+    int limitedRunning;
+    {
+        RefinementExecutor executor(1);
+        const auto job = [&]() {
+            const int now = ++ownRunning;
+            for (int m = ownMaxRunning; now > m && !ownMaxRunning.compare_exchange_weak(m, now);) {}
+
+            // wait a while for the jobs of the other owners, they run at the same time if the limit allows it
+            for (int i = 0; i < 200 && ownRunning < owners - 1; i++) std::this_thread::sleep_for(std::chrono::microseconds(100));
+            ownRunning--;
+            ownDone++;
+        };
+
+        for (int o = 1; o < owners; o++) executor.submit(&runningPerOwner[o], job);
+        while (ownDone < 1) std::this_thread::yield();
+        // only jobs started with the limit of 1 have run so far
+        limitedRunning = ownMaxRunning;
+        executor.setMaxConcurrency(owners - 1);
+        while (ownDone < owners - 1) std::this_thread::yield();
+
+        ownMaxRunning = 0;
+        for (int o = 1; o < owners; o++) executor.submit(&runningPerOwner[o], job);
+        while (ownDone < 2 * (owners - 1)) std::this_thread::yield();
+    }
+
+    // the jobs are slower than the submissions, so pending jobs have been replaced
+    std::cout << "jobs: " << jobs << " of " << 200 * owners << ", max running: " << maxRunning << std::endl;
+    std::cout << "own workers, max running: " << limitedRunning << " with a limit of 1 and " << ownMaxRunning << " after raising it" << std::endl;
+    passed = passed && maxRunning <= 2 && jobs > 0 && jobs < 200 * owners && limitedRunning == 1 && ownMaxRunning == owners - 1;
+
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
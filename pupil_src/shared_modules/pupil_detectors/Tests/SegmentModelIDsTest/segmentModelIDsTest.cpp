@@ -0,0 +1,103 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// Joins the model ids of segments like OfflineEyeModelFitter does: within one call and across the chunks of
+// consecutive calls, with models which continue at the boundary and ones which don't.
+
+#include <iostream>
+#include <vector>
+
+#include "SegmentModelIDs.h"
+
+
+using namespace singleeyefitter;
+
+namespace {
+
+    Detector3DResult result(int modelID, double birth, Sphere<double> sphere)
+    {
+        Detector3DResult r;
+        r.modelID = modelID;
+        r.modelBirthTimestamp = birth;
+        r.sphere = sphere;
+        return r;
+    }
+
+    bool check(const std::vector<Detector3DResult>& results, const std::vector<int>& ids, const std::vector<double>& births, const char* name)
+    {
+        bool passed = results.size() == ids.size();
+
+        for (size_t i = 0; passed && i < results.size(); i++) {
+            passed = results[i].modelID == ids[i] && results[i].modelBirthTimestamp == births[i];
+        }
+
+        std::cout << name << ":";
+        for (const auto& r : results) std::cout << " " << r.modelID << "@" << r.modelBirthTimestamp;
+        std::cout << (passed ? "" : " <- wrong") << std::endl;
+        return passed;
+    }
+
+} // namespace
+
+int main()
+{
+    std::cout << "Start Test" << std::endl;
+
+    const Sphere<double> eye(Vector3(0, 0, 40), 12);
+    const Sphere<double> close(Vector3(0.5, 0, 40), 12);
+    const Sphere<double> far(Vector3(5, 0, 40), 12);
+    bool passed = true;
+
+    // one call with three segments, the second continues the last model of the first one
+    {
+        SegmentModelIDs ids;
+        std::vector<Detector3DResult> results = {
+            result(1, 0.0, Sphere<double>::Null), result(1, 0.0, far), result(2, 1.0, eye), result(2, 1.0, eye),
+            result(1, 2.0, close), result(1, 2.0, close), result(2, 3.0, eye),
+            result(1, 4.0, far), result(3, 5.0, eye)
+        };
+        ids.join(results, 0, 4, 1.0);
+        ids.join(results, 4, 7, 1.0);
+        ids.join(results, 7, 9, 1.0);
+        passed &= check(results, {1, 1, 2, 2, 2, 2, 4, 5, 7}, {0, 0, 1, 1, 1, 1, 3, 4, 5}, "segments");
+    }
+
+    // the same segments in chunks of consecutive calls give the same ids
+    {
+        SegmentModelIDs ids;
+        std::vector<Detector3DResult> first = {result(1, 0.0, Sphere<double>::Null), result(1, 0.0, far), result(2, 1.0, eye), result(2, 1.0, eye)};
+        std::vector<Detector3DResult> second = {result(1, 2.0, close), result(1, 2.0, close), result(2, 3.0, eye)};
+        std::vector<Detector3DResult> third = {result(1, 4.0, far), result(3, 5.0, eye)};
+        ids.join(first, 0, first.size(), 1.0);
+        ids.join(second, 0, second.size(), 1.0);
+        ids.join(third, 0, third.size(), 1.0);
+        passed &= check(first, {1, 1, 2, 2}, {0, 0, 1, 1}, "chunk 1 ");
+        passed &= check(second, {2, 2, 4}, {1, 1, 3}, "chunk 2 ");
+        passed &= check(third, {5, 7}, {4, 5}, "chunk 3 ");
+    }
+
+    // a segment without a sphere at the boundary, or after one, never continues a model
+    {
+        SegmentModelIDs ids;
+        std::vector<Detector3DResult> results = {
+            result(1, 0.0, eye), result(1, 0.0, Sphere<double>::Null),
+            result(1, 2.0, eye),
+            result(1, 3.0, Sphere<double>::Null), result(2, 4.0, eye)
+        };
+        ids.join(results, 0, 2, 1.0);
+        ids.join(results, 2, 3, 1.0);
+        ids.join(results, 3, 5, 1.0);
+        passed &= check(results, {1, 1, 2, 3, 4}, {0, 0, 2, 3, 4}, "no sphere");
+    }
+
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
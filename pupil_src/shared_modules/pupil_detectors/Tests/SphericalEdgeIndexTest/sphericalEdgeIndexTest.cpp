@@ -0,0 +1,78 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// Compares the band counts of SphericalEdgeIndex with counting all edges, like EyeModelFitter::filterCircle3 did,
+// for edge clusters all over the sphere, also around the poles and where psi wraps around.
+
+#include <iostream>
+#include <random>
+
+#include "SphericalEdgeIndex.h"
+#include "mathHelper.h"
+
+
+using namespace singleeyefitter;
+
+int main()
+{
+    std::cout << "Start Test" << std::endl;
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    const Vector3 center(1, 2, 40);
+    const double radius = 12;
+    SphericalEdgeIndex index;
+    int failed = 0, total = 0;
+
+    for (int trial = 0; trial < 300; trial++) {
+        const double theta0 = trial % 10 == 0 ? 0.05 : std::acos(uniform(generator));
+        const double psi0 = trial % 7 == 0 ? 3.1 : constants::PI * uniform(generator);
+        Edges3D edges;
+
+        for (int i = 0; i < 2000; i++) {
+            edges.push_back(center + math::sph2cart(radius, theta0 + 0.4 * uniform(generator), psi0 + 0.4 * uniform(generator)));
+        }
+
+        index.build(center, radius, edges, 0.02 + 0.03 * (trial % 3), psi0);
+
+        for (int q = 0; q < 50; q++) {
+            const Vector3 point = center + math::sph2cart(radius, theta0 + 0.3 * uniform(generator), psi0 + 0.3 * uniform(generator));
+            const double bandRadius = 1.0 + 2.0 * std::abs(uniform(generator));
+            const double minDistanceSquared = std::pow(bandRadius - 0.2, 2);
+            const double maxDistanceSquared = std::pow(bandRadius + 0.2, 2);
+
+            int expectedCount = 0;
+            double expectedSum = 0.0;
+
+            for (const auto& e : edges) {
+                const double distanceSquared = (e - point).squaredNorm();
+
+                if (distanceSquared < maxDistanceSquared && distanceSquared > minDistanceSquared) {
+                    expectedCount++;
+                    expectedSum += std::sqrt(distanceSquared);
+                }
+            }
+
+            int count;
+            double sum;
+            index.countBand(point, minDistanceSquared, maxDistanceSquared, count, sum);
+            total++;
+
+            if (count != expectedCount || std::abs(sum - expectedSum) > 1e-9 * std::max(1.0, expectedSum)) {
+                failed++;
+            }
+        }
+    }
+
+    std::cout << "failed: " << failed << " of " << total << std::endl;
+    std::cout << (failed == 0 ? "PASSED" : "FAILED") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+"""
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+"""
+
+import math
+import multiprocessing
+import os
+
+import av
+import cv2
+import numpy as np
+import pytest
+
+from methods import Roi
+from pupil_detectors import Detector_2D, Detector_3D
+from pupil_detectors.structured_result import (
+    PUPIL_2D_DTYPE,
+    RESULT_RECORDS,
+    StaleResultError,
+    StructuredPupilResult,
+)
+
+single_data = os.path.join(
+    os.path.dirname(os.path.abspath(__file__)),
+    "../../../video_capture/tests/data/single/eye0.mp4",
+)
+
+
+class Frame:
+    def __init__(self, av_frame, timestamp):
+        self.img = av_frame.to_ndarray(format="bgr24")
+        self.gray = cv2.cvtColor(self.img, cv2.COLOR_BGR2GRAY)
+        self.height, self.width = self.gray.shape
+        self.timestamp = timestamp
+
+
+def frames(count):
+    container = av.open(single_data)
+    for index, av_frame in enumerate(container.decode(video=0)):
+        if index == count:
+            break
+        yield Frame(av_frame, index / 30.0)
+    container.close()
+
+
+def assert_same_datum(structured, expected, path="datum"):
+    if isinstance(expected, dict):
+        assert sorted(structured.keys()) == sorted(expected.keys()), path
+        for key in expected:
+            assert_same_datum(structured[key], expected[key], "{}.{}".format(path, key))
+    elif isinstance(expected, (tuple, list)):
+        assert len(structured) == len(expected), path
+        for index, (s, e) in enumerate(zip(structured, expected)):
+            assert_same_datum(s, e, "{}[{}]".format(path, index))
+    elif isinstance(expected, str):
+        assert structured == expected, path
+    elif math.isnan(expected):
+        assert math.isnan(structured), path
+    else:
+        assert structured == pytest.approx(expected, rel=1e-9, abs=1e-9), path
+
+
+def detect_both(detector_type, count):
+    # detections change the state of a detector, both kinds of results come from detectors with the same history
+    default, structured = detector_type(), detector_type()
+    for frame in frames(count):
+        roi = Roi(frame.gray.shape)
+        expected = default.detect(frame, roi, False)
+        result = structured.detect(frame, roi, False, structured=True)
+        yield result.to_dict(), expected
+
+
+def test_2d_record_matches_dict():
+    compared = 0
+    for structured, expected in detect_both(Detector_2D, 100):
+        assert_same_datum(structured, expected)
+        compared += 1
+    assert compared == 100
+
+
+def detect_3d(structured):
+    detector = Detector_3D()
+    detector.set_reproducible(True)
+    results = []
+    for frame in frames(None):
+        result = detector.detect(frame, Roi(frame.gray.shape), False, structured=structured)
+        results.append(result.to_dict() if structured else result)
+    return results
+
+
+def test_3d_record_matches_dict():
+    # the ransac of the eye models draws from a generator shared by the whole process, so both
+    # kinds of results come from a reproducible detector which runs alone in a new process
+    context = multiprocessing.get_context("spawn")
+    with context.Pool(1, maxtasksperchild=1) as pool:
+        expected = pool.apply(detect_3d, (False,))
+    with context.Pool(1, maxtasksperchild=1) as pool:
+        structured = pool.apply(detect_3d, (True,))
+
+    assert len(structured) == len(expected) > 100
+    for s, e in zip(structured, expected):
+        assert_same_datum(s, e)
+
+    # both the placeholders before the model exists and the values of a model are compared
+    first = expected[0]
+    assert first["projected_sphere"]["axes"] == (0.0, 0.0)
+    assert first["theta"] == 0 and first["phi"] == 0
+    assert any(e["projected_sphere"]["axes"] != (0.0, 0.0) for e in expected)
+    assert any(e["theta"] != 0 for e in expected)
+
+
+def test_overwritten_record_is_stale():
+    records = np.zeros(RESULT_RECORDS, dtype=PUPIL_2D_DTYPE)
+    sequences = np.zeros(RESULT_RECORDS, dtype=np.longlong)
+
+    results = []
+    for sequence in range(1, RESULT_RECORDS + 2):
+        index = (sequence - 1) % RESULT_RECORDS
+        records[index]["timestamp"] = sequence
+        sequences[index] = sequence
+        results.append(StructuredPupilResult(records, sequences, index))
+
+    kept = results[1]
+    assert kept["timestamp"] == 2.0
+
+    overwritten = results[0]
+    assert overwritten.stale
+    with pytest.raises(StaleResultError):
+        overwritten["timestamp"]
+
+    # a dict built before the record is overwritten stays valid
+    kept.to_dict()
+    sequences[kept.index] += RESULT_RECORDS
+    assert kept.stale
+    assert kept["timestamp"] == 2.0
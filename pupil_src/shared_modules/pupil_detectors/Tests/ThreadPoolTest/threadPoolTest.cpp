@@ -0,0 +1,49 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// parallelFor has to call the body once per index, also when it is called from a task of the pool itself.
+
+#include <atomic>
+#include <iostream>
+#include <vector>
+#include "ThreadPool.h"
+
+int main()
+{
+    std::cout << "Start Test" << std::endl;
+
+    using namespace singleeyefitter;
+    ThreadPool pool(3, {0});
+    const int rounds = 200;
+    const int count = 1000;
+    std::vector<std::atomic<int>> calls(count);
+    for (auto& c : calls) c = 0;
+
+    for (int r = 0; r < rounds; r++) {
+        pool.parallelFor(0, count, [&](int i) { calls[i]++; });
+    }
+
+    bool passed = true;
+    for (const auto& c : calls) passed &= c == rounds;
+
+    // every worker waits in a nested parallelFor, which only works if the callers take indices themselves
+    std::vector<std::future<void>> tasks;
+    for (int t = 0; t < pool.size(); t++) {
+        tasks.push_back(pool.submit([&]() { pool.parallelFor(0, count, [&](int i) { calls[i]++; }); }));
+    }
+    for (auto& t : tasks) t.wait();
+
+    for (const auto& c : calls) passed &= c == rounds + pool.size();
+
+    std::cout << "threads: " << pool.size() << " affinity: " << pool.hasAffinity() << std::endl;
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
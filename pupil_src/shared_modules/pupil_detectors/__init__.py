@@ -24,3 +24,4 @@ from .detector_dummy import Detector_Dummy
 
 # explicit import here for pyinstaller because it will not search .pyx source files.
 from .visualizer_3d import Eye_Visualizer
+from .structured_result import StructuredPupilResult
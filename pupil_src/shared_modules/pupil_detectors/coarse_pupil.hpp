@@ -0,0 +1,230 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+#ifndef coarse_pupil_hpp__
+#define coarse_pupil_hpp__
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "singleeyefitter/ThreadPool.h"
+
+
+// a dark square (inner) surrounded by a brighter one (outer), found by the coarse pupil search
+struct CoarsePupilCandidate {
+	int x, y; // top left corner of the outer square
+	int width; // width of the outer square, three times the inner one
+	float response; // mean of the outer square minus mean of the inner square
+};
+
+struct CoarsePupilResult {
+	// bounding box of the good candidates, (0, 0, 1, 1) if there is none
+	int x1, y1, x2, y2;
+	std::vector<CoarsePupilCandidate> good; // candidates with a good response, which don't surround another candidate
+	std::vector<CoarsePupilCandidate> candidates; // the candidates with the highest responses
+};
+
+namespace coarse_pupil {
+
+	// window positions are sampled with these strides, like the original Cython implementation
+	const int sHeightStep = 4;
+	const int sPositionStep = 5;
+	const size_t sMaxCandidates = 30;
+
+	// Scans one window size, row by row. Every window which beats the best response of the scale so far is recorded.
+	// A window which beats the best response of all scans before it beats the best response of its own scale as well,
+	// so the records of all scales contain every record of the sequential scan.
+	inline void scan_scale(const int* integral, int rows, int cols, size_t step, int h, std::vector<float>& responses, std::vector<CoarsePupilCandidate>& records)
+	{
+		const int w = 3 * h;
+		const float outer_f = float(1.0 / (w * w));
+		const float inner_f = float(-1.0 / (h * h));
+		float best_response = -10000;
+		records.clear();
+
+		if (cols - w <= 0) return;
+
+		responses.resize((cols - w + sPositionStep - 1) / sPositionStep);
+
+		for (int i = 0; i < rows - w; i += sPositionStep) {
+			const int* outer_top = integral + i * step;
+			const int* outer_bottom = integral + (i + w) * step;
+			const int* inner_top = integral + (i + h) * step;
+			const int* inner_bottom = integral + (i + h + h) * step;
+			float* response = responses.data();
+
+			// the responses of a row don't depend on each other, so this loop vectorizes
+			for (int j = 0; j < cols - w; j += sPositionStep) {
+				const int outer = outer_bottom[j + w] + outer_top[j] - outer_top[j + w] - outer_bottom[j];
+				const int inner = inner_bottom[j + h + h] + inner_top[j + h] - inner_top[j + h + h] - inner_bottom[j + h];
+				*response++ = outer_f * outer + inner_f * inner;
+			}
+
+			for (int k = 0; k < int(responses.size()); k++) {
+				if (responses[k] > best_response) {
+					best_response = responses[k];
+					CoarsePupilCandidate candidate = {k * sPositionStep, i, w, responses[k]};
+					records.push_back(candidate);
+				}
+			}
+		}
+	}
+
+	class ScanScales : public cv::ParallelLoopBody {
+		public:
+			ScanScales(const int* integral, int rows, int cols, size_t step, const std::vector<int>& heights, std::vector<std::vector<CoarsePupilCandidate>>& records)
+				: mIntegral(integral), mRows(rows), mCols(cols), mStep(step), mHeights(heights), mRecords(records) {};
+
+			void operator()(const cv::Range& range) const override
+			{
+				std::vector<float> responses;
+
+				for (int k = range.start; k < range.end; k++) {
+					scan_scale(mIntegral, mRows, mCols, mStep, mHeights[k], responses, mRecords[k]);
+				}
+			}
+
+		private:
+			const int* mIntegral;
+			int mRows, mCols;
+			size_t mStep;
+			const std::vector<int>& mHeights;
+			std::vector<std::vector<CoarsePupilCandidate>>& mRecords;
+	};
+
+} // namespace coarse_pupil
+
+// Center surround search for the pupil on an integral image (CV_32S, one row and column larger than the image).
+// The inner square width runs from min_w / 3 to max_w / 3, each width is scanned in parallel.
+// The scales are merged in order, which gives the same candidates as scanning them one after the other:
+// the windows which beat every window scanned before them. These increase in response,
+// so the last sMaxCandidates of them are the ones with the highest response.
+// The scales run on pool if given, otherwise on the threads of OpenCV.
+inline void center_surround_search(const int* integral, int rows, int cols, size_t step, int min_w, int max_w, CoarsePupilResult& result,
+                                   singleeyefitter::ThreadPool* pool = nullptr)
+{
+	using namespace coarse_pupil;
+
+	std::vector<int> heights;
+
+	for (int h = min_w / 3; h < max_w / 3; h += sHeightStep) {
+		heights.push_back(h);
+	}
+
+	std::vector<std::vector<CoarsePupilCandidate>> records(heights.size());
+
+	const ScanScales scan(integral, rows, cols, step, heights, records);
+
+	if (pool)
+		pool->parallelFor(0, int(heights.size()), [&](int k) { scan(cv::Range(k, k + 1)); });
+	else if (!heights.empty())
+		cv::parallel_for_(cv::Range(0, int(heights.size())), scan);
+
+	float best_response = -10000;
+	std::vector<CoarsePupilCandidate>& candidates = result.candidates;
+	candidates.clear();
+
+	for (const auto& scale_records : records) {
+		for (const auto& record : scale_records) {
+			if (record.response > best_response) {
+				best_response = record.response;
+				candidates.push_back(record);
+			}
+		}
+	}
+
+	if (candidates.size() > sMaxCandidates)
+		candidates.erase(candidates.begin(), candidates.end() - sMaxCandidates);
+
+	// remove candidates with a bad response and the ones which fully surround others, since we want the smallest ones
+	result.good.clear();
+
+	for (const auto& c : candidates) {
+		if (c.response < best_response * 0.4) continue;
+
+		bool surrounds = std::any_of(candidates.begin(), candidates.end(), [&](const CoarsePupilCandidate & o) {
+			return c.x < o.x && c.y < o.y && c.x + c.width > o.x + o.width && c.y + c.width > o.y + o.width;
+		});
+
+		if (!surrounds) result.good.push_back(c);
+	}
+
+	result.x1 = 0;
+	result.y1 = 0;
+	result.x2 = 1;
+	result.y2 = 1;
+
+	if (!result.good.empty()) {
+		result.x1 = result.good[0].x;
+		result.y1 = result.good[0].y;
+
+		for (const auto& c : result.good) {
+			result.x1 = std::min(c.x, result.x1);
+			result.y1 = std::min(c.y, result.y1);
+			result.x2 = std::max(c.x + c.width, result.x2);
+			result.y2 = std::max(c.y + c.width, result.y2);
+		}
+	}
+}
+
+inline void center_surround_search(const cv::Mat& integral, int min_w, int max_w, CoarsePupilResult& result, singleeyefitter::ThreadPool* pool = nullptr)
+{
+	CV_Assert(integral.type() == CV_32SC1);
+	center_surround_search(integral.ptr<int>(), integral.rows, integral.cols, integral.step1(), min_w, max_w, result, pool);
+}
+
+// Coarse pupil detection on the gray frame, without copies of the roi.
+// The integral image of every scale-th pixel of the roi is summed up in a buffer which is kept between frames.
+class CoarsePupilDetector {
+	public:
+		// the scales are searched on pool instead of the threads of OpenCV, nullptr to go back to those
+		void set_thread_pool(std::shared_ptr<singleeyefitter::ThreadPool> pool) { mThreadPool = pool; };
+
+		// min_w and max_w are in pixels of the frame, the candidates in result are in pixels of the decimated roi.
+		// Returns the bounding box of the good candidates in frame coordinates.
+		cv::Rect detect(const cv::Mat& gray, const cv::Rect& roi, int min_w, int max_w, int scale, CoarsePupilResult& result)
+		{
+			CV_Assert(gray.type() == CV_8UC1 && scale > 0);
+			const cv::Rect area = roi & cv::Rect(0, 0, gray.cols, gray.rows);
+			const int rows = (area.height + scale - 1) / scale;
+			const int cols = (area.width + scale - 1) / scale;
+
+			mIntegral.create(rows + 1, cols + 1, CV_32SC1);
+			std::fill(mIntegral.ptr<int>(0), mIntegral.ptr<int>(0) + cols + 1, 0);
+
+			for (int i = 0; i < rows; i++) {
+				const uchar* in = gray.ptr<uchar>(area.y + i * scale) + area.x;
+				const int* above = mIntegral.ptr<int>(i);
+				int* out = mIntegral.ptr<int>(i + 1);
+				int row_sum = 0;
+				out[0] = 0;
+
+				for (int j = 0; j < cols; j++) {
+					row_sum += in[j * scale];
+					out[j + 1] = above[j + 1] + row_sum;
+				}
+			}
+
+			center_surround_search(mIntegral, min_w / scale, max_w / scale, result, mThreadPool.get());
+
+			return cv::Rect(area.x + result.x1 * scale, area.y + result.y1 * scale,
+			                (result.x2 - result.x1) * scale, (result.y2 - result.y1) * scale);
+		}
+
+	private:
+		cv::Mat mIntegral;
+		std::shared_ptr<singleeyefitter::ThreadPool> mThreadPool;
+};
+
+#endif // coarse_pupil_hpp__
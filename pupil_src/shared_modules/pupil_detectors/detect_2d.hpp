@@ -9,6 +9,9 @@ See COPYING and COPYING.LESSER for license details.
 ---------------------------------------------------------------------------~(*)
 */
 
+#ifndef detect_2d_hpp__
+#define detect_2d_hpp__
+
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/videoio.hpp>
@@ -20,6 +23,7 @@ See COPYING and COPYING.LESSER for license details.
 #include "singleeyefitter/fun.h"
 #include "singleeyefitter/utils.h"
 #include "singleeyefitter/ImageProcessing/cvx.h"
+#include "singleeyefitter/ImageProcessing/DrawCommands.h"
 #include "geometry/Ellipse.h"  // use ellipse eyefitter
 #include "math/distance.h"
 #include "singleeyefitter/mathHelper.h"
@@ -27,6 +31,9 @@ See COPYING and COPYING.LESSER for license details.
 #include "singleeyefitter/EllipseDistanceApproxCalculator.h"
 #include "singleeyefitter/EllipseEvaluation2D.h"
 #include "singleeyefitter/ImageProcessing/GuoHallThinner.h"
+#include "singleeyefitter/ImageProcessing/EdgePixelIndex.h"
+#include "singleeyefitter/ImageProcessing/EdgeMaskFilter.h"
+#include "singleeyefitter/BitsetList.h"
 
 class Detector2D {
 
@@ -39,14 +46,118 @@ class Detector2D {
 		Detector2D();
 		std::shared_ptr<Detector2DResult> detect(Detector2DProperties& props, cv::Mat& image, cv::Mat& color_image, cv::Mat& debug_image, cv::Rect& roi, bool visualize, bool use_debug_image, bool pause_video);
 		std::vector<cv::Point> ellipse_true_support(Detector2DProperties& props, Ellipse& ellipse, double ellipse_circumference, std::vector<cv::Point>& raw_edges);
+		size_t ellipse_true_support_count(const Ellipse& ellipse, double min_dist, const std::vector<cv::Point>& raw_edges) const;
+
+		// if deferred, detect records the visualization instead of drawing it into color_image
+		// and render_visualization draws the one of the last detection, e.g. only when the frame is displayed
+		void set_deferred_visualization(bool deferred) { mDeferVisualization = deferred; };
+		void render_visualization(cv::Mat& color_image) const { mVisualization.render(color_image); };
+		// the candidate contours are evaluated on pool, nullptr to evaluate them on the calling thread
+		void set_thread_pool(std::shared_ptr<singleeyefitter::ThreadPool> pool) { mThreadPool = pool; };
 
 
 	private:
 
+		// detector for the given pyramid level, its kernels are scaled down accordingly
+		explicit Detector2D(int pyramid_level);
+
 		bool mUse_strong_prior;
+		bool mDeferVisualization = false;
+		singleeyefitter::DrawCommands mVisualization;
 		int mPupil_Size;
+		int mVisualizedPupil_Size; // mPupil_Size of the last frame
 		Ellipse mPrior_ellipse;
 
+		// last two strong detections in image coordinates, used to predict the tracking window
+		Ellipse mTrackLast;
+		Ellipse mTrackPrevious;
+		int mTrackLength;
+
+		bool mCollectTimings;
+		Clock::time_point mStageStart;
+
+		// per frame workspace, reused by every detect call so steady state detection does not allocate
+		// the image buffers grow to the largest roi seen and are used through views of the current roi size
+		cv::Mat mPupilImage;
+		cv::Mat mBinaryImage;
+		cv::Mat mSpecMask;
+		cv::Mat mEdges;
+		cv::Mat mHistogram;
+		const cv::Mat mDilateKernel;
+		const cv::Mat mOpenKernel;
+		singleeyefitter::EdgeMaskFilter mEdgeMaskFilter;
+		Contours_2D mContours;
+		Contours_2D mApproxContours;
+		Contours_2D mSplitContours;
+		std::vector<int> mStrongContours;
+		std::vector<int> mWeakContours;
+		Contours_2D mResolvedContours; // grows only, so the resolved edges of a contour keep their capacity
+		std::vector<int> mBestContourIndices;
+		std::vector<cv::Point> mBestContour;
+		singleeyefitter::EdgePixelIndex mEdgeIndex;
+		std::vector<double> mSupportDistances;
+
+		// coarse to fine detection
+		cv::Mat mPyramidImage;
+		std::unique_ptr<Detector2D> mCoarseDetector;
+		std::shared_ptr<singleeyefitter::ThreadPool> mThreadPool;
+
+		// combinatorial search state
+		std::vector<cv::Point> mTestContour;
+		std::vector<int> mMapping;
+		singleeyefitter::BitsetList mUnknownPaths;
+		std::vector<int> mUnknownPathSizes;
+		std::vector<int> mUnknownPathLast;
+		singleeyefitter::BitsetList mPrunedPaths;
+		std::vector<singleeyefitter::BitsetList::Word> mCurrentPath;
+		singleeyefitter::BitsetList mSolutions;
+		singleeyefitter::BitsetList mFilteredSolutions;
+		singleeyefitter::EllipseFitter2D::Scatters mSplitScatters;
+		singleeyefitter::EllipseFitter2D::Scatters mResolvedScatters;
+		singleeyefitter::EllipseFitter2D::Scatter mPathScatter;
+
+		// returns a continuous image of the given size in the memory of buffer, the buffer is only reallocated if it is too small
+		// the image is not a submatrix of buffer, otherwise filters would read the rest of the buffer as neighbouring pixels
+		static cv::Mat workspaceView(cv::Mat& buffer, const cv::Size& size, int type)
+		{
+			const size_t bytes = size_t(size.area()) * CV_ELEM_SIZE(type);
+
+			if (buffer.total() * buffer.elemSize() < bytes)
+				buffer.create(1, int(bytes), CV_8UC1);
+
+			return cv::Mat(size, type, buffer.data);
+		};
+
+		// runs the detection on the window of the image, after the histogram thresholds are known
+		std::shared_ptr<Detector2DResult> detect_in_window(Detector2DProperties& props, cv::Mat& image, cv::Mat& color_image, cv::Mat& debug_image, const cv::Rect& roi,
+		        int lowest_spike_index, int highest_spike_index, bool visualize, bool use_debug_image, Detector2DTimings& timings);
+
+		// detection on the downsampled window, refined on full resolution around the coarse ellipse
+		std::shared_ptr<Detector2DResult> detect_coarse_to_fine(Detector2DProperties& props, cv::Mat& image, cv::Mat& color_image, cv::Mat& debug_image, const cv::Rect& roi,
+		        int lowest_spike_index, int highest_spike_index, bool visualize, bool use_debug_image, Detector2DTimings& timings);
+
+		// morphology, blur, canny and masks on roi_image, the returned edges are a view into the workspace
+		// the masks are only written to the workspace if keep_masks is set
+		cv::Mat filter_edges(Detector2DProperties& props, const cv::Mat& roi_image, int lowest_spike_index, int highest_spike_index, bool keep_masks, Detector2DTimings& timings);
+
+		bool fit_strong_prior(Detector2DProperties& props, Ellipse ellipse, const cv::Rect& roi, std::vector<cv::Point>& raw_edges, cv::Mat& debug_image, bool use_debug_image, Detector2DResult& result);
+
+		// the pupil size limits and the size of the last frame, recorded after the window visualization
+		void visualize_pupil_size(const Detector2DProperties& props, int image_height);
+
+		// predicts center and half size of the tracking window from the last strong detections
+		bool predict_tracking_window(const Detector2DProperties& props, cv::Point2d& center, double& half_size) const;
+
+		// adds the ticks since the last stage finished to the given stage
+		void finishStage(Clock::rep& stage)
+		{
+			if (!mCollectTimings) return;
+
+			Clock::time_point now = Clock::now();
+			stage += (now - mStageStart).count();
+			mStageStart = now;
+		};
+
 
 
 };
@@ -56,122 +167,375 @@ void printPoints(std::vector<cv::Point> points)
 	std::for_each(points.begin(), points.end(), [](cv::Point & p) { std::cout << p << std::endl;});
 }
 
-Detector2D::Detector2D(): mUse_strong_prior(false), mPupil_Size(100) {};
+Detector2D::Detector2D(): Detector2D(0) {};
+
+Detector2D::Detector2D(int pyramid_level): mUse_strong_prior(false), mPupil_Size(100), mVisualizedPupil_Size(100), mTrackLength(0), mCollectTimings(false),
+	mDilateKernel(cv::getStructuringElement(cv::MORPH_ELLIPSE, {(7 >> pyramid_level) | 1, (7 >> pyramid_level) | 1})),
+	mOpenKernel(cv::getStructuringElement(cv::MORPH_ELLIPSE, {(9 >> pyramid_level) | 1, (9 >> pyramid_level) | 1})),
+	mEdgeMaskFilter(mDilateKernel) {};
 
 std::vector<cv::Point> Detector2D::ellipse_true_support(Detector2DProperties& props,Ellipse& ellipse, double ellipse_circumference, std::vector<cv::Point>& raw_edges)
 {
 	std::vector<cv::Point> support_pixels;
 	EllipseDistCalculator<double> ellipseDistance(ellipse);
+	mSupportDistances.resize(raw_edges.size());
+	auto batch = ellipseDistance.batch(raw_edges, props.ellipse_true_support_min_dist, mSupportDistances.data());
+	support_pixels.reserve(batch.inlier_count);
 
-	for (auto& p : raw_edges) {
-		double distance = std::abs(ellipseDistance((double)p.x, (double)p.y));
-		if (distance <=  props.ellipse_true_support_min_dist) {
-			support_pixels.emplace_back(p);
+	for (size_t i = 0; i < raw_edges.size(); i++) {
+		if (std::abs(mSupportDistances[i]) <=  props.ellipse_true_support_min_dist) {
+			support_pixels.emplace_back(raw_edges[i]);
 		}
 	}
 	return support_pixels;
 }
+// same as ellipse_true_support(...).size(), without collecting the pixels
+size_t Detector2D::ellipse_true_support_count(const Ellipse& ellipse, double min_dist, const std::vector<cv::Point>& raw_edges) const
+{
+	EllipseDistCalculator<double> ellipseDistance(ellipse);
+	return ellipseDistance.batch(raw_edges, min_dist).inlier_count;
+}
 std::shared_ptr<Detector2DResult> Detector2D::detect(Detector2DProperties& props, cv::Mat& image, cv::Mat& color_image, cv::Mat& debug_image, cv::Rect& roi, bool visualize, bool use_debug_image, bool pause_video = false)
 {
-	std::shared_ptr<Detector2DResult> result = std::make_shared<Detector2DResult>();
-	result->current_roi = roi;
-	result->image_width =  image.size().width;
-	result->image_height =  image.size().height;
+	mCollectTimings = props.collect_timings;
+	if (mCollectTimings) mStageStart = Clock::now();
 
+	Detector2DTimings timings;
 	const int image_width = image.size().width;
-	const int image_height = image.size().height;
-	const cv::Mat pupil_image = cv::Mat(image, roi).clone();  // image with roi, copy the image, since we alter it
-	const int w = pupil_image.size().width / 2;
-	const float coarse_pupil_width = w / 2.0f;
-	const int padding = int(coarse_pupil_width / 4.0f);
+	const cv::Mat roi_image = cv::Mat(image, roi);
 	const int offset = props.intensity_range;
 	const int spectral_offset = 5;
 
-	cv::Mat histogram;
+	// the thresholds always come from the whole roi, a tight window around the pupil has a different histogram
+	cv::Mat& histogram = mHistogram;
 	int histSize;
 	histSize = 256; //from 0 to 255
 	/// Set the ranges
 	float range[] = { 0, 256 } ; //the upper boundary is exclusive
 	const float* histRange = { range };
-	cv::calcHist(&pupil_image, 1 , 0, cv::Mat(), histogram , 1 , &histSize, &histRange, true, false);
+	cv::calcHist(&roi_image, 1 , 0, cv::Mat(), histogram , 1 , &histSize, &histRange, true, false);
 
 	int lowest_spike_index = 255;
 	int highest_spike_index = 0;
 	float max_intensity = 0;
 	singleeyefitter::detector::calculate_spike_indices_and_max_intenesity(histogram, 40, lowest_spike_index, highest_spike_index, max_intensity);
+	finishStage(timings.histogram);
+
+	mVisualization.clear();
+	cv::Mat* const visualization_target = mDeferVisualization ? nullptr : &color_image;
 
 	if (visualize) {
+		mVisualization.setTarget(visualization_target);
+
 		const int scale_x  = 100;
 		const int scale_y = 1 ;
 
 		// display the histogram and the spikes
 		for (int i = 0; i < histogram.rows; i++) {
 			const float norm_i  = histogram.ptr<float>(i)[0] / max_intensity ; // normalized intensity
-			cv::line(color_image, {image_width, i * scale_y}, { image_width - int(norm_i * scale_x), i * scale_y}, mBlue_color);
+			mVisualization.line({image_width, i * scale_y}, { image_width - int(norm_i * scale_x), i * scale_y}, mBlue_color);
 		}
 
-		cv::line(color_image, {image_width, lowest_spike_index * scale_y}, { int(image_width - 0.5f * scale_x), lowest_spike_index * scale_y }, mRed_color);
-		cv::line(color_image, {image_width, (lowest_spike_index + offset)* scale_y}, { int(image_width - 0.5f * scale_x), (lowest_spike_index + offset)* scale_y }, mYellow_color);
-		cv::line(color_image, {image_width, (highest_spike_index)* scale_y}, { int(image_width - 0.5f * scale_x), highest_spike_index * scale_y }, mRed_color);
-		cv::line(color_image, {image_width, (highest_spike_index - spectral_offset)* scale_y}, { int(image_width - 0.5f * scale_x), (highest_spike_index - spectral_offset)* scale_y }, mWhite_color);
+		mVisualization.line({image_width, lowest_spike_index * scale_y}, { int(image_width - 0.5f * scale_x), lowest_spike_index * scale_y }, mRed_color);
+		mVisualization.line({image_width, (lowest_spike_index + offset)* scale_y}, { int(image_width - 0.5f * scale_x), (lowest_spike_index + offset)* scale_y }, mYellow_color);
+		mVisualization.line({image_width, (highest_spike_index)* scale_y}, { int(image_width - 0.5f * scale_x), highest_spike_index * scale_y }, mRed_color);
+		mVisualization.line({image_width, (highest_spike_index - spectral_offset)* scale_y}, { int(image_width - 0.5f * scale_x), (highest_spike_index - spectral_offset)* scale_y }, mWhite_color);
 	}
 
-	//create dark and spectral glint masks
-	cv::Mat binary_img,spec_mask,kernel;
-	cv::inRange(pupil_image, cv::Scalar(0) , cv::Scalar(lowest_spike_index + props.intensity_range), binary_img);    // binary threshold
-	kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, {7, 7});
-	cv::dilate(binary_img, binary_img, kernel, { -1, -1}, 2);
-	cv::inRange(pupil_image, cv::Scalar(0) , cv::Scalar(highest_spike_index - spectral_offset), spec_mask);    // binary threshold
-	cv::erode(spec_mask, spec_mask, kernel);
+	// real pupil size of this frame is calculated further down, so the visualized size is from the last frame
+	mVisualizedPupil_Size = mPupil_Size;
+
+	// in tracking mode the detection first runs on a window around the predicted pupil
+	// if it fails the window is widened geometrically, until the whole roi is used like without tracking
+	std::shared_ptr<Detector2DResult> result;
+	cv::Point2d window_center;
+	double window_half_size = 0.0;
+	bool tracking = props.tracking && predict_tracking_window(props, window_center, window_half_size);
+
+	// only the visualization and the stage timings of the window whose result is returned are reported
+	// while tracking the visualization is recorded, even if it is drawn directly, since a failed window is dropped
+	const size_t window_commands = mVisualization.size();
+	const Detector2DTimings window_timings = timings;
+
+	if (visualize && tracking)
+		mVisualization.setTarget(nullptr);
+
+	for (;;) {
+		mVisualization.truncate(window_commands);
+		timings = window_timings;
+		cv::Rect window = roi;
+
+		if (tracking) {
+			window = cv::Rect(cvRound(window_center.x - window_half_size), cvRound(window_center.y - window_half_size),
+			                  cvRound(2.0 * window_half_size), cvRound(2.0 * window_half_size)) & roi;
+
+			if (window == roi || window.width < props.pupil_size_min || window.height < props.pupil_size_min) {
+				tracking = false;
+				window = roi;
+			}
+		}
+
+		if (props.pyramid_detection)
+			result = detect_coarse_to_fine(props, image, color_image, debug_image, window, lowest_spike_index, highest_spike_index, visualize, use_debug_image, timings);
+		else
+			result = detect_in_window(props, image, color_image, debug_image, window, lowest_spike_index, highest_spike_index, visualize, use_debug_image, timings);
+
+		if (!tracking || mUse_strong_prior) break;
+
+		window_half_size *= 2.0;
+	}
+
+	// in direct mode only the commands of the window were recorded
+	if (visualize && visualization_target) {
+		mVisualization.render(*visualization_target);
+		mVisualization.clear();
+		mVisualization.setTarget(visualization_target);
+	}
+
+	// only strong detections are tracked, anything else starts a new track
+	if (mUse_strong_prior) {
+		mTrackPrevious = mTrackLast;
+		mTrackLast = mPrior_ellipse;
+		mTrackLength++;
+	} else {
+		mTrackLength = 0;
+	}
+
+	result->timings = timings;
+	return result;
+}
+bool Detector2D::predict_tracking_window(const Detector2DProperties& props, cv::Point2d& center, double& half_size) const
+{
+	if (mTrackLength == 0) return false;
+
+	// constant velocity on center and axes, one frame ahead
+	double dx = 0.0, dy = 0.0, dr = 0.0;
+
+	if (mTrackLength >= 2) {
+		dx = mTrackLast.center[0] - mTrackPrevious.center[0];
+		dy = mTrackLast.center[1] - mTrackPrevious.center[1];
+		dr = mTrackLast.major_radius - mTrackPrevious.major_radius;
+	}
+
+	const double predicted_radius = std::max(mTrackLast.major_radius + dr, props.pupil_size_min / 2.0);
+	center = cv::Point2d(mTrackLast.center[0] + dx, mTrackLast.center[1] + dy);
+	// the last motion is added as margin for the prediction error
+	half_size = props.tracking_window_scale * predicted_radius + std::sqrt(dx * dx + dy * dy);
+	return half_size > 0.0;
+}
+void Detector2D::visualize_pupil_size(const Detector2DProperties& props, int image_height)
+{
+	//draw size ellipses
+	cv::Point center(100, image_height - 100);
+	mVisualization.circle(center, props.pupil_size_min / 2.0, mRed_color);
+	mVisualization.circle(center, mVisualizedPupil_Size / 2.0, mGreen_color);
+	mVisualization.circle(center, props.pupil_size_max / 2.0, mRed_color);
+	auto text_string = std::to_string(mVisualizedPupil_Size);
+	cv::Size text_size = cv::getTextSize(text_string, cv::FONT_HERSHEY_SIMPLEX, 0.4 , 1, 0);
+	cv::Point text_pos = { center.x - text_size.width / 2 , center.y + text_size.height / 2};
+	mVisualization.text(text_string, text_pos, 0.4, mRoyalBlue_color);
+}
+cv::Mat Detector2D::filter_edges(Detector2DProperties& props, const cv::Mat& roi_image, int lowest_spike_index, int highest_spike_index, bool keep_masks, Detector2DTimings& timings)
+{
+	// filtered copy of the roi image, we don't alter the original image
+	cv::Mat pupil_image = workspaceView(mPupilImage, roi_image.size(), roi_image.type());
+	const int spectral_offset = 5;
 
-	kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, {9, 9});
 	//open operation to remove eye lashes
-	cv::morphologyEx(pupil_image, pupil_image, cv::MORPH_OPEN, kernel);
+	//the roi is a view into the image, isolate it so the pixels around it don't change the result
+	cv::morphologyEx(roi_image, pupil_image, cv::MORPH_OPEN, mOpenKernel, { -1, -1}, 1, cv::BORDER_CONSTANT | cv::BORDER_ISOLATED);
+	finishStage(timings.morphology_open);
 
 	if (props.blur_size > 1)
 		cv::medianBlur(pupil_image, pupil_image, props.blur_size);
+	finishStage(timings.median_blur);
 
-	cv::Mat edges;
+	cv::Mat edges = workspaceView(mEdges, roi_image.size(), CV_8UC1);
 	cv::Canny(pupil_image, edges, props.canny_treshold, props.canny_treshold * props.canny_ration, props.canny_aperture);
+	finishStage(timings.canny);
 
 	//remove edges in areas not dark enough and where the glint is (spectral refelction from IR leds)
-	cv::min(edges, spec_mask, edges);
-	cv::min(edges, binary_img, edges);
+	//dark mask: threshold dilated twice, glint mask: threshold eroded once, both computed in one pass with the edges
+	cv::Mat binary_img, spec_mask;
 
-	if (visualize) {
-		// get sub matrix
-		cv::Mat overlay = cv::Mat(color_image, roi);
-		cv::Mat g_channel(overlay.rows, overlay.cols, CV_8UC1);
-		cv::Mat b_channel(overlay.rows, overlay.cols, CV_8UC1);
-		cv::Mat r_channel(overlay.rows, overlay.cols, CV_8UC1);
-		cv::Mat out[] = {b_channel, g_channel, r_channel};
+	if (keep_masks) {
+		binary_img = workspaceView(mBinaryImage, roi_image.size(), CV_8UC1);
+		spec_mask = workspaceView(mSpecMask, roi_image.size(), CV_8UC1);
+	}
+
+	mEdgeMaskFilter.apply(roi_image, edges, lowest_spike_index + props.intensity_range, highest_spike_index - spectral_offset,
+	                      keep_masks ? &binary_img : nullptr, keep_masks ? &spec_mask : nullptr);
+	finishStage(timings.masks);
+	return edges;
+}
+// checks if ellipse (in roi coordinates) is supported by the raw edges and refits it to the support
+// on success the refit ellipse becomes the strong prior and raw_edges is moved into the result
+bool Detector2D::fit_strong_prior(Detector2DProperties& props, Ellipse ellipse, const cv::Rect& roi, std::vector<cv::Point>& raw_edges, cv::Mat& debug_image, bool use_debug_image, Detector2DResult& result)
+{
+	double ellipse_circumference = ellipse.circumference();
+	std::vector<cv::Point> support_pixels = ellipse_true_support(props, ellipse, ellipse_circumference, raw_edges);
+	double support_ratio = support_pixels.size() / ellipse_circumference;
+
+	if (support_ratio < props.strong_perimeter_ratio_range_min)
+		return false;
+
+	cv::RotatedRect refit_ellipse = cv::fitEllipse(support_pixels);
+
+	if(use_debug_image){
+		cv::ellipse(debug_image, toRotatedRect(ellipse), mRoyalBlue_color, 4);
+		cv::ellipse(debug_image, refit_ellipse, mRed_color, 1);
+	}
+
+	ellipse = toEllipse<double>(refit_ellipse);
+
+	ellipse_circumference = ellipse.circumference();
+	size_t support_count_narrow = ellipse_true_support_count(ellipse, props.ellipse_true_support_min_dist, raw_edges);
+	size_t support_count_wide = ellipse_true_support_count(ellipse, props.ellipse_true_support_min_dist * 2., raw_edges);
+	support_ratio = pow((float(support_count_narrow)/float(support_count_wide)), props.support_pixel_ratio_exponent)  * (float(support_count_narrow)/ float(ellipse_circumference));
+	ellipse.center[0] += roi.x;
+	ellipse.center[1] += roi.y;
+
+	mPrior_ellipse = ellipse;
+	mUse_strong_prior = true;
+	double goodness = std::min(1.0, support_ratio);
+	mPupil_Size = ellipse.major_radius * 2.0;
+	result.confidence = goodness;
+	result.ellipse = ellipse;
+
+	//result.final_contours = std::move(best_contours); // no contours when strong prior
+	//result.contours = std::move(split_contours);
+	result.raw_edges = std::move(raw_edges); // do we need it when strong prior ?
+	result.final_edges = std::move(support_pixels);  // need for optimisation
+	return true;
+}
+// detects the pupil on the first pyramid level of the roi, the coarse ellipse is then used like a strong prior
+// on full resolution, which only needs the edges in a band around it
+// if there is no coarse ellipse or full resolution doesn't confirm it, the full resolution detection runs instead
+std::shared_ptr<Detector2DResult> Detector2D::detect_coarse_to_fine(Detector2DProperties& props, cv::Mat& image, cv::Mat& color_image, cv::Mat& debug_image, const cv::Rect& roi,
+        int lowest_spike_index, int highest_spike_index, bool visualize, bool use_debug_image, Detector2DTimings& timings)
+{
+	if (!mCoarseDetector)
+		mCoarseDetector.reset(new Detector2D(1));
+
+	// only the timings of the returned detection are reported, the full resolution fallback starts over
+	const Detector2DTimings entry_timings = timings;
+	Detector2D& coarse = *mCoarseDetector;
+	coarse.mThreadPool = mThreadPool;
+	cv::Mat coarse_image = workspaceView(mPyramidImage, cv::Size((roi.width + 1) / 2, (roi.height + 1) / 2), image.type());
+	cv::pyrDown(cv::Mat(image, roi), coarse_image, coarse_image.size());
+
+	// pixel sizes and squared distances are scaled to the coarse level
+	Detector2DProperties coarse_props = props;
+	coarse_props.pupil_size_min = props.pupil_size_min / 2;
+	coarse_props.pupil_size_max = props.pupil_size_max / 2;
+	coarse_props.contour_size_min = props.contour_size_min / 2;
+	coarse_props.blur_size = (props.blur_size / 2) | 1;
+	coarse_props.ellipse_true_support_min_dist = props.ellipse_true_support_min_dist / 2.0f;
+	coarse_props.initial_ellipse_fit_treshhold = props.initial_ellipse_fit_treshhold / 4.0f;
+
+	// the coarse detector starts from the prior of this detector, in coordinates of the coarse image
+	coarse.mUse_strong_prior = mUse_strong_prior;
+	coarse.mPrior_ellipse = mPrior_ellipse;
+	coarse.mPrior_ellipse.center[0] = (mPrior_ellipse.center[0] - roi.x) / 2.0;
+	coarse.mPrior_ellipse.center[1] = (mPrior_ellipse.center[1] - roi.y) / 2.0;
+	coarse.mPrior_ellipse.major_radius = mPrior_ellipse.major_radius / 2.0;
+	coarse.mPrior_ellipse.minor_radius = mPrior_ellipse.minor_radius / 2.0;
+	coarse.mCollectTimings = mCollectTimings;
+	coarse.mStageStart = mStageStart;
+	cv::Mat no_image;
+	auto coarse_result = coarse.detect_in_window(coarse_props, coarse_image, no_image, no_image, cv::Rect(0, 0, coarse_image.cols, coarse_image.rows),
+	                     lowest_spike_index, highest_spike_index, false, false, timings);
+	mStageStart = coarse.mStageStart;
+	mUse_strong_prior = false;
+
+	if (coarse_result->ellipse == Ellipse::Null) {
+		timings = entry_timings;
+		return detect_in_window(props, image, color_image, debug_image, roi, lowest_spike_index, highest_spike_index, visualize, use_debug_image, timings);
+	}
+
+	// back to full resolution roi coordinates, the pixels of the coarse level are centered on the even pixels
+	Ellipse ellipse = coarse_result->ellipse;
+	ellipse.center *= 2.0;
+	ellipse.major_radius *= 2.0;
+	ellipse.minor_radius *= 2.0;
+
+	// the band covers the localisation error of the coarse level and the wide support used for the confidence
+	// the box around it gets some more margin, so the filters see the same neighbourhood as on the whole roi
+	const double band = 2.0 * props.ellipse_true_support_min_dist + 2.0;
+	const int margin = int(std::ceil(band)) + mOpenKernel.cols;
+	cv::Rect box = toRotatedRect(ellipse).boundingRect();
+	box = cv::Rect(box.x + roi.x - margin, box.y + roi.y - margin, box.width + 2 * margin, box.height + 2 * margin) & roi;
+	ellipse.center[0] -= box.x - roi.x;
+	ellipse.center[1] -= box.y - roi.y;
+
+	std::shared_ptr<Detector2DResult> result = std::make_shared<Detector2DResult>();
+	result->current_roi = box;
+	result->image_width =  image.size().width;
+	result->image_height =  image.size().height;
 
-		cv::split(overlay, out);
+	cv::Mat edges = filter_edges(props, cv::Mat(image, box), lowest_spike_index, highest_spike_index, false, timings);
+	std::vector<cv::Point> box_edges;
+	singleeyefitter::cvx::findNonZero(edges, box_edges);
+	finishStage(timings.canny);
 
-		cv::max(g_channel, edges, g_channel);
-		cv::max(b_channel, binary_img, b_channel);
-		cv::min(b_channel, spec_mask, b_channel);
-		cv::merge(out, 3, overlay);
+	std::vector<cv::Point> raw_edges;
+
+	if (!box_edges.empty()) {
+		EllipseDistCalculator<double> ellipseDistance(ellipse);
+		mSupportDistances.resize(box_edges.size());
+		ellipseDistance.batch(box_edges, band, mSupportDistances.data());
+
+		for (size_t i = 0; i < box_edges.size(); i++) {
+			if (std::abs(mSupportDistances[i]) <= band)
+				raw_edges.push_back(box_edges[i]);
+		}
+	}
+
+	bool found = !raw_edges.empty() && fit_strong_prior(props, ellipse, box, raw_edges, debug_image, use_debug_image, *result);
+	finishStage(timings.final_fitting);
+
+	if (found) {
+		if (visualize) {
+			mVisualization.dottedRect(box, cv::Rect(0, 0, box.width, box.height), mWhite_color);
+			visualize_pupil_size(props, image.size().height);
+		}
+
+		return result;
+	}
+
+	timings = entry_timings;
+	return detect_in_window(props, image, color_image, debug_image, roi, lowest_spike_index, highest_spike_index, visualize, use_debug_image, timings);
+}
+std::shared_ptr<Detector2DResult> Detector2D::detect_in_window(Detector2DProperties& props, cv::Mat& image, cv::Mat& color_image, cv::Mat& debug_image, const cv::Rect& roi,
+        int lowest_spike_index, int highest_spike_index, bool visualize, bool use_debug_image, Detector2DTimings& timings)
+{
+	std::shared_ptr<Detector2DResult> result = std::make_shared<Detector2DResult>();
+	result->current_roi = roi;
+	result->image_width =  image.size().width;
+	result->image_height =  image.size().height;
+
+	const cv::Mat roi_image = cv::Mat(image, roi);
+	cv::Mat edges = filter_edges(props, roi_image, lowest_spike_index, highest_spike_index, visualize, timings);
+	// the filter results are kept in the workspace
+	const cv::Mat pupil_image = workspaceView(mPupilImage, roi_image.size(), roi_image.type());
+	const cv::Mat binary_img = workspaceView(mBinaryImage, roi_image.size(), CV_8UC1);
+	const cv::Mat spec_mask = workspaceView(mSpecMask, roi_image.size(), CV_8UC1);
+	const int w = pupil_image.size().width / 2;
+	const float coarse_pupil_width = w / 2.0f;
+	const int padding = int(coarse_pupil_width / 4.0f);
+
+	if (visualize) {
+		// edges in green, the pupil mask in blue
+		mVisualization.maskOverlay(roi, edges, binary_img, spec_mask);
 
 		//draw a frame around the automatic pupil ROI in overlay.
-		auto rect = cv::Rect(0, 0, overlay.size().width, overlay.size().height);
-		cvx::draw_dotted_rect(overlay, rect, mWhite_color);
+		mVisualization.dottedRect(roi, cv::Rect(0, 0, roi.width, roi.height), mWhite_color);
 
 		//draw a frame around the area we require the pupil center to be.
-		rect = cv::Rect(padding, padding, roi.width - padding, roi.height - padding);
-		cvx::draw_dotted_rect(overlay, rect, mWhite_color);
-
-		//draw size ellipses
-		cv::Point center(100, image_height - 100);
-		cv::circle(color_image, center, props.pupil_size_min / 2.0, mRed_color);
-
-		// real pupil size of this frame is calculated further down, so this size is from the last frame
-		cv::circle(color_image, center, mPupil_Size / 2.0, mGreen_color);
-		cv::circle(color_image, center, props.pupil_size_max / 2.0, mRed_color);
-		auto text_string = std::to_string(mPupil_Size);
-		cv::Size text_size = cv::getTextSize(text_string, cv::FONT_HERSHEY_SIMPLEX, 0.4 , 1, 0);
-		cv::Point text_pos = { center.x - text_size.width / 2 , center.y + text_size.height / 2};
-		cv::putText(color_image, text_string, text_pos, cv::FONT_HERSHEY_SIMPLEX, 0.4, mRoyalBlue_color);
+		mVisualization.dottedRect(roi, cv::Rect(padding, padding, roi.width - padding, roi.height - padding), mWhite_color);
+
+		// after the overlay, which would paint over the circles where the roi covers them
+		visualize_pupil_size(props, image.size().height);
 	}
 
 
@@ -183,6 +547,7 @@ std::shared_ptr<Detector2DResult> Detector2D::detect(Detector2DProperties& props
 	std::vector<cv::Point> raw_edges;
     // find zero crashes if it doesn't find one. replace with cv implementation if opencv version is 3.0 or above
 	singleeyefitter::cvx::findNonZero(edges, raw_edges);
+	finishStage(timings.canny);
 
 
 	///////////////////////////////
@@ -197,69 +562,36 @@ std::shared_ptr<Detector2DResult> Detector2D::detect(Detector2DProperties& props
 	  ellipse.center[0] -= roi.x  ;
 	  ellipse.center[1] -= roi.y ;
 
-	  if( !raw_edges.empty() ){
+	  bool found = !raw_edges.empty() && fit_strong_prior(props, ellipse, roi, raw_edges, debug_image, use_debug_image, *result);
+	  finishStage(timings.final_fitting);
 
-	    std::vector<cv::Point> support_pixels;
-	    double ellipse_circumference = ellipse.circumference();
-	    support_pixels = ellipse_true_support(props,ellipse, ellipse_circumference, raw_edges);
-	    double support_ratio = support_pixels.size() / ellipse_circumference;
-
-	    if(support_ratio >= props.strong_perimeter_ratio_range_min){
-	      	cv::RotatedRect refit_ellipse = cv::fitEllipse(support_pixels);
-
-			if(use_debug_image){
-			  cv::ellipse(debug_image, toRotatedRect(ellipse), mRoyalBlue_color, 4);
-			  cv::ellipse(debug_image, refit_ellipse, mRed_color, 1);
-			}
-
-			ellipse = toEllipse<double>(refit_ellipse);
-
-	    	ellipse_circumference = ellipse.circumference();
-			auto support_pixels_narrow = ellipse_true_support(props,ellipse, ellipse_circumference, raw_edges);
-			props.ellipse_true_support_min_dist *=2.;
-			auto support_pixels_wide = ellipse_true_support(props,ellipse, ellipse_circumference, raw_edges);
-			props.ellipse_true_support_min_dist /=2.;
-	     	support_ratio = pow((float(support_pixels_narrow.size())/float(support_pixels_wide.size())), props.support_pixel_ratio_exponent)  * (float(support_pixels_narrow.size())/ float(ellipse_circumference));
-			ellipse.center[0] += roi.x;
-			ellipse.center[1] += roi.y;
-
-			mPrior_ellipse = ellipse;
-			mUse_strong_prior = true;
-			double goodness = std::min(1.0, support_ratio);
-			mPupil_Size = ellipse.major_radius * 2.0;
-		 	result->confidence = goodness;
-			result->ellipse = ellipse;
-
-			//result->final_contours = std::move(best_contours); // no contours when strong prior
-			//result->contours = std::move(split_contours);
-			result->raw_edges = std::move(raw_edges); // do we need it when strong prior ?
-			result->final_edges = std::move(support_pixels);  // need for optimisation
-	      	return result;
-	    }
-	  }
+	  if (found) return result;
 	}
 	///////////////////////////////
 	///  Strong Prior Part End  ///
 	///////////////////////////////
 
 	//from edges to contours
-	Contours_2D contours ;
+	Contours_2D& contours = mContours;
 	cv::findContours(edges, contours, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
-
-	//first we want to filter out the bad stuff, to short ones
-	const auto contour_size_min_pred = [&props](const Contour_2D & contour) {
-		return contour.size() > props.contour_size_min;
-	};
-	contours = singleeyefitter::fun::filter(contour_size_min_pred , contours);
+	finishStage(timings.find_contours);
 
 	//now we learn things about each contour through looking at the curvature.
 	//For this we need to simplyfy the contour so that pt to pt angles become more meaningfull
-	Contours_2D approx_contours;
-	std::for_each(contours.begin(), contours.end(), [&](const Contour_2D & contour) {
-		std::vector<cv::Point> approx_c;
-		cv::approxPolyDP(contour, approx_c, 1.5, false);
-		approx_contours.push_back(std::move(approx_c));
-	});
+	//first we want to filter out the bad stuff, to short ones
+	Contours_2D& approx_contours = mApproxContours;
+	size_t approx_count = 0;
+
+	for (const auto& contour : contours) {
+		if (contour.size() <= props.contour_size_min) continue;
+
+		if (approx_count == approx_contours.size())
+			approx_contours.emplace_back();
+
+		cv::approxPolyDP(contour, approx_contours[approx_count++], 1.5, false);
+	}
+
+	approx_contours.resize(approx_count);
 
 	// split contours looking at curvature and angle
 	double split_angle = 80;
@@ -269,7 +601,10 @@ std::shared_ptr<Detector2DResult> Detector2D::detect(Detector2DProperties& props
 	//removing stubs makes combinatorial search feasable
 	//  MOVED TO split_contours_optimized
 	//split_contours = singleeyefitter::fun::filter( [](std::vector<cv::Point>& v){ return v.size() <= 3;} , split_contours);
-	Contours_2D split_contours = singleeyefitter::detector::split_rough_contours_optimized(approx_contours, split_angle , split_contour_size_min);
+	Contours_2D& split_contours = mSplitContours;
+	singleeyefitter::detector::split_rough_contours_optimized(approx_contours, split_angle , split_contour_size_min, split_contours);
+
+	finishStage(timings.split_contours);
 
 	if (split_contours.empty()) {
 		result->confidence = 0.0;
@@ -297,18 +632,29 @@ std::shared_ptr<Detector2DResult> Detector2D::detect(Detector2DProperties& props
 	const cv::Rect ellipse_center_varianz = cv::Rect(padding, padding, pupil_image.size().width - 2.0 * padding, pupil_image.size().height - 2.0 * padding);
 	const EllipseEvaluation2D is_Ellipse(ellipse_center_varianz, props.ellipse_roundness_ratio, props.pupil_size_min, props.pupil_size_max);
 
-	//finding potential candidates for ellipse seeds that describe the pupil.
-	auto seed_contours  = detector::divide_strong_and_weak_contours(
-	                          split_contours, is_Ellipse, props.initial_ellipse_fit_treshhold,
-	                          props.strong_perimeter_ratio_range_min, props.strong_perimeter_ratio_range_max,
-	                          props.strong_area_ratio_range_min, props.strong_area_ratio_range_max
-	                      );
-	std::vector<int> seed_indices = seed_contours.first; // strong contours
-
-	if (seed_indices.empty() && !seed_contours.second.empty()) {
-		seed_indices = seed_contours.second; // weak contours
+	// ellipses of contour combinations are fitted to the sum of the contour scatter matrices
+	// so the scatter matrix of every split contour is computed only once
+	const EllipseFitter2D fitter(cv::Point2d(pupil_image.cols / 2.0, pupil_image.rows / 2.0), std::max(pupil_image.cols, pupil_image.rows) / 2.0);
+	EllipseFitter2D::Scatters& split_scatters = mSplitScatters;
+	split_scatters.resize(split_contours.size());
+
+	for (int i = 0; i < split_contours.size(); i++) {
+		split_scatters[i].setZero();
+		fitter.addPoints(split_contours[i], split_scatters[i]);
 	}
 
+	//finding potential candidates for ellipse seeds that describe the pupil.
+	detector::divide_strong_and_weak_contours(
+	    split_contours, split_scatters, fitter, is_Ellipse, props.initial_ellipse_fit_treshhold,
+	    props.strong_perimeter_ratio_range_min, props.strong_perimeter_ratio_range_max,
+	    props.strong_area_ratio_range_min, props.strong_area_ratio_range_max,
+	    mStrongContours, mWeakContours, mThreadPool.get()
+	);
+	// strong contours, or the weak ones if there are none
+	const std::vector<int>& seed_indices = mStrongContours.empty() ? mWeakContours : mStrongContours;
+
+	finishStage(timings.divide_contours);
+
 	// still empty ? --> exits
 	if (seed_indices.empty()) {
 		result->confidence = 0.0;
@@ -320,149 +666,183 @@ std::shared_ptr<Detector2DResult> Detector2D::detect(Detector2DProperties& props
 		return result;
 	}
 
-	auto pruning_quick_combine = [&](const std::vector<std::vector<cv::Point>>& contours,  std::set<int>& seed_indices, int max_evals = 1e20, int max_depth = 5) {
-		// describes different combinations of contours
-		typedef std::set<int> Path;
-		// combinations we wanna test
-		std::vector<Path> unknown(seed_indices.size());
-		// init with paths of size 1 == seed indices
-		int n = 0;
-		std::generate(unknown.begin(), unknown.end(), [&]() { return Path{n++}; }); // fill with increasing values, starting from 0
-		std::vector<int> mapping; // contains all indices, starting with seed_indices
-		mapping.reserve(contours.size());
-		mapping.insert(mapping.begin(), seed_indices.begin(), seed_indices.end());
+	// contour combinations are bitsets over positions in mapping, solutions are bitsets over contour indices
+	auto pruning_quick_combine = [&](const std::vector<std::vector<cv::Point>>& contours,  const std::vector<int>& seed_indices, BitsetList& results, int max_evals = 1000, int max_depth = 5) {
+		typedef BitsetList::Word Word;
+		const int words = (contours.size() + 63) / 64;
+		std::vector<int>& mapping = mMapping; // contains all indices, starting with the sorted seed_indices
+		mapping.assign(seed_indices.begin(), seed_indices.end());
+		std::sort(mapping.begin(), mapping.end());
+		mapping.erase(std::unique(mapping.begin(), mapping.end()), mapping.end());
+		const int seed_count = mapping.size();
 
 		// add indices which are not used to the end of mapping
 		for (int i = 0; i < contours.size(); i++) {
-			if (seed_indices.find(i) == seed_indices.end()) { mapping.push_back(i); }
+			if (!std::binary_search(mapping.begin(), mapping.begin() + seed_count, i)) { mapping.push_back(i); }
 		}
 
-		// contains all the indices for the contours, which altogther fit best
-		std::vector<Path> results;
+		// combinations we wanna test, used as a stack
+		// for each combination we keep its size and its highest position, so it is only extended by higher ones
+		BitsetList& unknown = mUnknownPaths;
+		std::vector<int>& unknown_sizes = mUnknownPathSizes;
+		std::vector<int>& unknown_last = mUnknownPathLast;
+		unknown.reset(contours.size());
+		unknown_sizes.clear();
+		unknown_last.clear();
+
+		// init with paths of size 1 == seed indices
+		for (int n = 0; n < seed_count; n++) {
+			BitsetList::set(unknown.push_back(), n);
+			unknown_sizes.push_back(1);
+			unknown_last.push_back(n);
+		}
 
 		// contains bad paths, we won't test again
 		// even a superset is not tested again, because if a subset is bad, we can't make it better if more contours are added
-		std::vector<Path> prune;
+		BitsetList& prune = mPrunedPaths;
+		prune.reset(contours.size());
+		results.reset(contours.size());
+		std::vector<Word>& current_path = mCurrentPath;
+		std::vector<cv::Point>& test_contour = mTestContour;
 		int eval_count = 0;
 
-		while (!unknown.empty() && eval_count <= max_evals) {
+		while (!unknown_sizes.empty() && eval_count <= max_evals) {
 			eval_count++;
 			//take a path and combine it with others to see if the fit gets better
-			Path current_path = unknown.back();
+			current_path.assign(unknown.back(), unknown.back() + words);
+			const int current_size = unknown_sizes.back();
+			const int current_last = unknown_last.back();
 			unknown.pop_back();
+			unknown_sizes.pop_back();
+			unknown_last.pop_back();
 
-			if (current_path.size() <= max_depth) {
-				bool includes_bad_paths = fun::isSubset(current_path, prune);
+			if (current_size <= max_depth) {
+				bool includes_bad_paths = prune.containsSubsetOf(current_path.data());
 
 				if (!includes_bad_paths) {
-					int size = 0;
-
-					for (int j : current_path) { size += contours.at(mapping.at(j)).size(); };
-
-					std::vector<cv::Point> test_contour;
-
-					test_contour.reserve(size);
-
-					std::set<int> test_contour_indices;
-
-					//concatenate contours to one contour
-					for (int k : current_path) {
-						const std::vector<cv::Point>& c = contours.at(mapping.at(k));
-						test_contour.insert(test_contour.end(), c.begin(), c.end());
-						test_contour_indices.insert(mapping.at(k));
-					}
-
 					//we have not tested this and a subset of this was sucessfull before
-					double fit_variance = detector::contour_ellipse_deviation_variance(test_contour);
+					double fit_variance;
+					EllipseFitter2D::Scatter& scatter = mPathScatter;
+					scatter.setZero();
+					BitsetList::forEachBit(current_path.data(), words, [&](int k) { scatter += split_scatters.at(mapping.at(k)); });
+					cv::RotatedRect cv_ellipse;
+
+					if (fitter.fit(scatter, cv_ellipse)) {
+						// mean squared distance of all points, no need to concatenate the contours
+						EllipseDistCalculator<double> ellipseDistance(toEllipse<double>(cv_ellipse));
+						double distance_sum = 0.0;
+						int point_count = 0;
+						BitsetList::forEachBit(current_path.data(), words, [&](int k) {
+							const std::vector<cv::Point>& c = contours.at(mapping.at(k));
+							distance_sum += ellipseDistance.batch(c, 0.0).squared_sum;
+							point_count += c.size();
+						});
+						fit_variance = distance_sum / double(point_count);
+					} else {
+						// degenerated point sets are handled by opencv, as before
+						test_contour.clear();
+						BitsetList::forEachBit(current_path.data(), words, [&](int k) {
+							const std::vector<cv::Point>& c = contours.at(mapping.at(k));
+							test_contour.insert(test_contour.end(), c.begin(), c.end());
+						});
+						fit_variance = detector::contour_ellipse_deviation_variance(test_contour);
+					}
 
 					if (fit_variance < props.initial_ellipse_fit_treshhold) {
 						//yes this was good, keep as solution
-						results.push_back(test_contour_indices);
+						Word* test_contour_indices = results.push_back();
+						BitsetList::forEachBit(current_path.data(), words, [&](int k) { BitsetList::set(test_contour_indices, mapping.at(k)); });
 
 						//lets explore more by creating paths to each remaining node
-						for (int l = (*current_path.rbegin()) + 1 ; l < mapping.size(); l++) {
-							unknown.push_back(current_path);
-							unknown.back().insert(l); // add a new path
+						for (int l = current_last + 1 ; l < mapping.size(); l++) {
+							BitsetList::set(unknown.push_back(current_path.data()), l); // add a new path
+							unknown_sizes.push_back(current_size + 1);
+							unknown_last.push_back(l);
 						}
 
 					} else {
-						prune.push_back(current_path);
+						prune.push_back(current_path.data());
 					}
 				}
 			}
 		}
-
-		return results;
 	};
-	std::set<int> seed_indices_set = std::set<int>(seed_indices.begin(), seed_indices.end());
-	std::vector<std::set<int>> solutions = pruning_quick_combine(split_contours, seed_indices_set, 1000, 5);
+	pruning_quick_combine(split_contours, seed_indices, mSolutions, 1000, 5);
 
 	//find largest sets which contains all previous ones
-	auto filter_subset = [](std::vector<std::set<int>>& sets) {
-		std::vector<std::set<int>> filtered_set;
-		int i = 0;
+	auto filter_subset = [](const BitsetList& sets, BitsetList& filtered_set) {
+		filtered_set.reset(sets.words() * 64);
 
-		for (auto& current_set : sets) {
+		for (int i = 0; i < sets.size(); i++) {
 			//check if this current_set is a subset of set
 			bool isSubset = false;
 
-			for (int j = 0; j < sets.size(); j++) {
+			for (int j = 0; j < sets.size() && !isSubset; j++) {
 				if (j == i) continue;// don't compare to itself
 
-				auto& set = sets.at(j);
-				// for std::include both containers need to be ordered. std::set guarantees this
-				isSubset |= std::includes(set.begin(), set.end(), current_set.begin(), current_set.end());
+				isSubset = BitsetList::isSubset(sets[i], sets[j], sets.words());
 			}
 
 			if (!isSubset) {
-				filtered_set.push_back(current_set);
+				filtered_set.push_back(sets[i]);
 			}
-
-			i++;
 		}
-
-		return filtered_set;
 	};
 
-	solutions = filter_subset(solutions);
+	const BitsetList& solutions = mFilteredSolutions;
+	filter_subset(mSolutions, mFilteredSolutions);
+	finishStage(timings.combinatorial_search);
 
-    Contours_2D split_contours_resolved(split_contours.size()); // WILL CONTAIN RESOLVED SPLIT CONTOURS TO TEST QUALITY OF CANDIDATE ELLIPSES
+	Contours_2D& split_contours_resolved = mResolvedContours; // WILL CONTAIN RESOLVED SPLIT CONTOURS TO TEST QUALITY OF CANDIDATE ELLIPSES
+	if (split_contours_resolved.size() < split_contours.size())
+		split_contours_resolved.resize(split_contours.size());
 
-    auto resolve_contour = [&](std::vector<cv::Point>& contour, cv::Mat & edges) -> std::vector<cv::Point> {
-		cv::Mat support_mask(edges.rows, edges.cols, edges.type(), {0, 0, 0});
-		cv::polylines(support_mask, contour, false, {255, 255, 255}, 2);
-		cv::Mat new_edges;
-		std::vector<cv::Point> new_contours;
-		cv::min(edges, support_mask, new_edges);
-		cv::findNonZero(new_edges, new_contours);
-		return new_contours;
-	};
+	for (int i = 0; i < split_contours.size(); i++) {
+		split_contours_resolved[i].clear();
+	}
+
+	EllipseFitter2D::Scatters& resolved_scatters = mResolvedScatters;
+	resolved_scatters.resize(split_contours.size());
+
+	// the real edge pixels under a contour drawn with thickness 2 are looked up in an index of raw_edges,
+	// the contour is only drawn into a mask of its bounding box instead of the whole edge image
+	mEdgeIndex.build(raw_edges, edges.size());
+	// the first raw edge is the pixel cvx::findNonZero sets to avoid crashing, it is not in edges
+	if (!raw_edges.empty() && raw_edges.front() == cv::Point(0, 0) && edges.at<uchar>(0, 0) == 0)
+		mEdgeIndex.exclude(0);
 
     double max_support_ratio = props.final_perimeter_ratio_range_min; //KEEPS TRACK OF MAXIMUM SUPPORT RATIO REACHED SO FAR
 
 	int index_best_Solution = -1;
 	int enum_index = 0;
 
-	for (auto& s : solutions) {
+	for (int s = 0; s < solutions.size(); s++) {
+
+		std::vector<cv::Point>& test_contour = mTestContour;
+		test_contour.clear();
 
-		std::vector<cv::Point> test_contour;
+		EllipseFitter2D::Scatter& scatter = mPathScatter;
+		scatter.setZero();
 
-		for (int i : s) {
+		BitsetList::forEachBit(solutions[s], solutions.words(), [&](int i) {
 
             //RESOLVE CONTOUR IF IT IS PART OF A SOLUTION AND HAS NOT BEEN RESOLVED YET
 		    if (split_contours_resolved[i].size()==0){
-                std::vector<cv::Point> generated_edges = resolve_contour(split_contours[i], edges);
-                split_contours_resolved[i].reserve(std::distance(generated_edges.begin(), generated_edges.end()));
-                split_contours_resolved[i].insert(split_contours_resolved[i].end(), generated_edges.begin(), generated_edges.end());
+                mEdgeIndex.query(split_contours[i], split_contours_resolved[i]);
+                resolved_scatters[i] = fitter.scatter(split_contours_resolved[i]);
             }
 
     		//CONCATENATE CONTOURS TO ONE CONTOUR
 			std::vector<cv::Point>& c = split_contours_resolved.at(i);
      		test_contour.insert(test_contour.end(), c.begin(), c.end());
+			scatter += resolved_scatters[i];
 
-		}
+		});
+
+		cv::RotatedRect cv_ellipse;
 
-		auto cv_ellipse = cv::fitEllipse(test_contour);
+		if (!fitter.fit(scatter, cv_ellipse))
+			cv_ellipse = cv::fitEllipse(test_contour);
 
 		if (use_debug_image) {
 			cv::ellipse(debug_image, cv_ellipse , mRed_color);
@@ -470,8 +850,8 @@ std::shared_ptr<Detector2DResult> Detector2D::detect(Detector2DProperties& props
 
 		Ellipse ellipse = toEllipse<double>(cv_ellipse);
 		double ellipse_circumference = ellipse.circumference();
-		std::vector<cv::Point>  support_pixels = ellipse_true_support(props, ellipse, ellipse_circumference, test_contour);
-		double support_ratio = (support_pixels.size() / ellipse_circumference)*pow(support_pixels.size()/test_contour.size(), props.support_pixel_ratio_exponent);
+		size_t support_count = ellipse_true_support_count(ellipse, props.ellipse_true_support_min_dist, test_contour);
+		double support_ratio = (support_count / ellipse_circumference)*pow(support_count/test_contour.size(), props.support_pixel_ratio_exponent);
 		//TODO: refine the selection of final candidate
 
 		if (support_ratio >= max_support_ratio && is_Ellipse(cv_ellipse)) {
@@ -498,6 +878,7 @@ std::shared_ptr<Detector2DResult> Detector2D::detect(Detector2DProperties& props
 
 	if (index_best_Solution == -1) {
 		// no good final ellipse found
+		finishStage(timings.final_fitting);
 		result->confidence = 0.0;
 		// Does it make seens to return anything ?
 		//result->ellipse = toEllipse<double>(refit_ellipse);
@@ -507,51 +888,31 @@ std::shared_ptr<Detector2DResult> Detector2D::detect(Detector2DProperties& props
 		return result;
 	}
 
-	auto& best_solution = solutions.at(index_best_Solution);
-	std::vector<std::vector<cv::Point>> best_contours;
-	std::vector<cv::Point>best_contour;
+	const BitsetList::Word* best_solution = solutions[index_best_Solution];
+	std::vector<int>& best_contours = mBestContourIndices;
+	std::vector<cv::Point>& best_contour = mBestContour;
+	best_contours.clear();
+	best_contour.clear();
 
 	//concatenate contours to one contour
-	for (int i : best_solution) {
+	BitsetList::forEachBit(best_solution, solutions.words(), [&](int i) {
 		std::vector<cv::Point>& c = split_contours.at(i);
-		best_contours.push_back(c);
+		best_contours.push_back(i);
 		best_contour.insert(best_contour.end(), c.begin(), c.end());
-	}
+	});
 
 	auto cv_ellipse = cv::fitEllipse(best_contour);
 	//final fitting on resolved contour
-	auto final_fitting = [&](std::vector<std::vector<cv::Point>>& contours, cv::Mat & edges) -> std::vector<cv::Point> {
-		//use the real edge pixels to fit, not the aproximated contours
-		cv::Mat support_mask(edges.rows, edges.cols, edges.type(), {0, 0, 0});
-		cv::polylines(support_mask, contours, false, {255, 255, 255}, 2);
-
-		//draw into the suport mask with thickness 2
-		cv::Mat new_edges;
-		std::vector<cv::Point> new_contours;
-		cv::min(edges, support_mask, new_edges);
-
-		// can't do this here, because final result gets much distorted.
-		// see if it even can crash !!!
-		//new_edges.at<int>(0,0) = 1; // find zero crashes if it doesn't find one. remove if opencv version is 3.0 or above
-		cv::findNonZero(new_edges, new_contours);
-
-		if (visualize)
-		{
-			cv::Mat overlay = color_image.colRange(roi.x, roi.x + roi.width).rowRange(roi.y, roi.y + roi.height);
-			cv::Mat g_channel(overlay.rows, overlay.cols, CV_8UC1);
-			cv::Mat b_channel(overlay.rows, overlay.cols, CV_8UC1);
-			cv::Mat r_channel(overlay.rows, overlay.cols, CV_8UC1);
-			cv::Mat out[] = {b_channel, g_channel, r_channel};
-			cv::split(overlay, out);
-			cv::threshold(new_edges, new_edges, 0, 255, cv::THRESH_BINARY);
-			cv::max(r_channel, new_edges, r_channel);
-			cv::merge(out, 3, overlay);
-		}
-
-		return new_contours;
+	//use the real edge pixels to fit, not the aproximated contours
+	//the edges under the contours drawn with thickness 2, like a support mask of the edge image
+	std::vector<cv::Point>& final_edges = result->final_edges;
+	mEdgeIndex.query(split_contours, best_contours, final_edges);
+
+	if (visualize)
+	{
+		mVisualization.points(final_edges, roi.tl(), 2);
+	}
 
-	};
-	std::vector<cv::Point> final_edges = final_fitting(best_contours, edges);
 	auto cv_new_Ellipse = cv::fitEllipse(final_edges);
 	double size_difference  = std::abs(1.0 - cv_ellipse.size.height / cv_new_Ellipse.size.height);
 	auto& cv_final_Ellipse = cv_ellipse;
@@ -568,9 +929,9 @@ std::shared_ptr<Detector2DResult> Detector2D::detect(Detector2DProperties& props
 
     // final calculation of goodness of fit on final_edges
     double ellipse_circumference = (result->ellipse).circumference();
-    std::vector<cv::Point>  support_pixels = ellipse_true_support(props, result->ellipse, ellipse_circumference, final_edges);
-	double support_ratio = support_pixels.size() / ellipse_circumference;
-	double goodness = std::min(double(0.99),support_ratio)*pow(support_pixels.size()/final_edges.size(), props.support_pixel_ratio_exponent);
+    size_t support_count = ellipse_true_support_count(result->ellipse, props.ellipse_true_support_min_dist, final_edges);
+	double support_ratio = support_count / ellipse_circumference;
+	double goodness = std::min(double(0.99),support_ratio)*pow(support_count/final_edges.size(), props.support_pixel_ratio_exponent);
 
 	result->confidence = goodness;
 	result->ellipse.center[0] += roi.x;
@@ -587,10 +948,10 @@ std::shared_ptr<Detector2DResult> Detector2D::detect(Detector2DProperties& props
 	// split_contours = singleeyefitter::detector::split_rough_contours_optimized(approx_contours, 150.0 , split_contour_size_min);
 
 	// result->contours = std::move(split_contours);
-	result->final_edges = std::move(final_edges);// need for optimisation
-
 	result->raw_edges = std::move(raw_edges);
+	finishStage(timings.final_fitting);
 	return result;
 
 }
 
+#endif // detect_2d_hpp__
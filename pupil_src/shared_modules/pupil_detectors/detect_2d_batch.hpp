@@ -0,0 +1,111 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+#ifndef detect_2d_batch_hpp__
+#define detect_2d_batch_hpp__
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "detect_2d.hpp"
+#include "coarse_pupil.hpp"
+
+
+struct Detector2DBatchOptions {
+	bool coarse_detection = false;
+	int coarse_filter_min = 128;
+	int coarse_filter_max = 280;
+	int segment_length = 0; // frames per segment, 0 spreads the frames evenly over the threads
+	bool keep_edges = false; // the edges are only needed to fit the 3D model, they would take up a lot of memory otherwise
+};
+
+// Offline 2D detection of many frames in one call.
+// The frames are split into segments of consecutive frames, which run in parallel on their own Detector2D,
+// so the strong prior carries over from frame to frame within a segment like in the online detection.
+class Detector2DBatch {
+	public:
+		// frames are gray images (CV_8UC1), rois the user roi of every frame
+		static void detect(const Detector2DProperties& props, const Detector2DBatchOptions& options,
+		                   const std::vector<cv::Mat>& frames, const std::vector<cv::Rect>& rois, std::vector<Detector2DResult>& results)
+		{
+			CV_Assert(frames.size() == rois.size());
+			results.clear();
+			results.resize(frames.size());
+
+			if (frames.empty()) return;
+
+			int segment_length = options.segment_length;
+
+			if (segment_length <= 0) {
+				const int threads = std::max(1, cv::getNumThreads());
+				segment_length = int((frames.size() + threads - 1) / threads);
+			}
+
+			const int segments = int((frames.size() + segment_length - 1) / segment_length);
+			cv::parallel_for_(cv::Range(0, segments), Segments(props, options, segment_length, frames, rois, results));
+		}
+
+	private:
+
+		class Segments : public cv::ParallelLoopBody {
+			public:
+				Segments(const Detector2DProperties& props, const Detector2DBatchOptions& options, int segment_length,
+				         const std::vector<cv::Mat>& frames, const std::vector<cv::Rect>& rois, std::vector<Detector2DResult>& results)
+					: mProps(props), mOptions(options), mSegmentLength(segment_length), mFrames(frames), mRois(rois), mResults(results) {};
+
+				void operator()(const cv::Range& range) const override
+				{
+					for (int segment = range.start; segment < range.end; segment++) {
+						const size_t begin = size_t(segment) * mSegmentLength;
+						const size_t end = std::min(mFrames.size(), begin + mSegmentLength);
+						detect_segment(begin, end);
+					}
+				}
+
+			private:
+				const Detector2DProperties& mProps;
+				const Detector2DBatchOptions& mOptions;
+				const int mSegmentLength;
+				const std::vector<cv::Mat>& mFrames;
+				const std::vector<cv::Rect>& mRois;
+				std::vector<Detector2DResult>& mResults;
+
+				// the frames of a segment are detected in order, same as Detector_2D.detect does online
+				void detect_segment(size_t begin, size_t end) const
+				{
+					Detector2D detector;
+					CoarsePupilDetector coarse_detector;
+					CoarsePupilResult coarse_result;
+					Detector2DProperties props = mProps;
+					cv::Mat no_color, no_debug;
+
+					for (size_t i = begin; i < end; i++) {
+						cv::Mat image = mFrames[i];
+						cv::Rect roi = mRois[i] & cv::Rect(0, 0, image.cols, image.rows);
+
+						if (mOptions.coarse_detection && roi.area() > 320 * 240) {
+							roi = coarse_detector.detect(image, roi, mOptions.coarse_filter_min, mOptions.coarse_filter_max, 2, coarse_result);
+						}
+
+						mResults[i] = *detector.detect(props, image, no_color, no_debug, roi, false, false);
+
+						if (!mOptions.keep_edges) {
+							Edges2D().swap(mResults[i].raw_edges);
+							Edges2D().swap(mResults[i].final_edges);
+						}
+					}
+				}
+		};
+};
+
+#endif // detect_2d_batch_hpp__
@@ -25,6 +25,7 @@ cdef extern from '<opencv2/core.hpp>' namespace 'cv':
   cdef cppclass Mat :
       Mat() except +
       Mat( int height, int width, int type, void* data  ) except+
+      Mat( int height, int width, int type, void* data, size_t step  ) except+
       Mat( int height, int width, int type ) except+
 
 cdef extern from '<opencv2/core.hpp>' namespace 'cv':
@@ -89,6 +90,20 @@ cdef extern from 'common/types.h':
     ctypedef Circle3D[double] Circle
     ctypedef Ellipse2D[double] Ellipse
 
+    cdef struct Detector2DTimings:
+        long long histogram
+        long long masks
+        long long morphology_open
+        long long median_blur
+        long long canny
+        long long find_contours
+        long long split_contours
+        long long divide_contours
+        long long combinatorial_search
+        long long final_fitting
+
+    double ticksToMilliseconds(long long ticks)
+
     cdef struct Detector2DResult:
         double confidence
         Ellipse ellipse
@@ -98,6 +113,7 @@ cdef extern from 'common/types.h':
         double timestamp
         int image_width
         int image_height
+        Detector2DTimings timings
 
     cdef struct ModelDebugProperties:
         Sphere[double] sphere
@@ -145,6 +161,10 @@ cdef extern from 'common/types.h':
         float final_perimeter_ratio_range_max
         float ellipse_true_support_min_dist
         float support_pixel_ratio_exponent
+        bint collect_timings
+        bint tracking
+        float tracking_window_scale
+        bint pyramid_detection
 
     cdef struct Detector3DProperties:
         float model_sensitivity
@@ -152,13 +172,38 @@ cdef extern from 'common/types.h':
 
 
 
+cdef extern from 'singleeyefitter/ThreadPool.h' namespace 'singleeyefitter':
+
+  cdef cppclass ThreadPool:
+    ThreadPool( int threads, const vector[int]& cpus ) except +
+    int size()
+    bint hasAffinity()
+
+
 cdef extern from 'detect_2d.hpp':
 
 
   cdef cppclass Detector2D:
 
     Detector2D() except +
-    shared_ptr[Detector2DResult] detect( Detector2DProperties& prop, Mat& image, Mat& color_image, Mat& debug_image, Rect_[int]& roi, bint visualize , bint use_debug_image )
+    shared_ptr[Detector2DResult] detect( Detector2DProperties& prop, Mat& image, Mat& color_image, Mat& debug_image, Rect_[int]& roi, bint visualize , bint use_debug_image ) nogil
+    void set_deferred_visualization( bint deferred )
+    void render_visualization( Mat& color_image ) nogil
+    void set_thread_pool( shared_ptr[ThreadPool] pool )
+
+
+cdef extern from 'detect_2d_batch.hpp':
+
+  cdef struct Detector2DBatchOptions:
+    bint coarse_detection
+    int coarse_filter_min
+    int coarse_filter_max
+    int segment_length
+    bint keep_edges
+
+  cdef cppclass Detector2DBatch:
+    @staticmethod
+    void detect( const Detector2DProperties& props, const Detector2DBatchOptions& options, const vector[Mat]& frames, const vector[Rect_[int]]& rois, vector[Detector2DResult]& results ) nogil except +
 
 
 cdef extern from "singleeyefitter/EyeModelFitter.h" namespace "singleeyefitter":
@@ -179,16 +224,27 @@ cdef extern from "singleeyefitter/EyeModelFitter.h" namespace "singleeyefitter":
 
         EyeModelFitter(double focalLength )
 
-        Detector3DResult updateAndDetect( shared_ptr[Detector2DResult]& results, const Detector3DProperties& prop, bint fillDebugResult )
+        Detector3DResult updateAndDetect( shared_ptr[Detector2DResult]& results, const Detector3DProperties& prop, bint fillDebugResult ) nogil
 
         void reset()
         double getFocalLength()
+        void setThreadPool( shared_ptr[ThreadPool] pool )
+        void setMaxRefinements( int count )
+        void setBackgroundRefinement( bint enabled )
+        void setUseObservationTime( bint use )
 
 
         double mFocalLength
         Sphere[double] mCurrentSphere
 
 
+cdef extern from "singleeyefitter/OfflineEyeModelFitter.h" namespace "singleeyefitter":
 
+    cdef struct OfflineFitterOptions:
+        int segment_length
+        int warmup_length
+        double merge_distance
 
-
+    cdef cppclass OfflineEyeModelFitter:
+        OfflineEyeModelFitter(double focalLength) except +
+        void fit( const vector[Detector2DResult]& observations, const Detector3DProperties& props, const OfflineFitterOptions& options, vector[Detector3DResult]& results ) nogil except +
@@ -17,13 +17,14 @@ import cv2
 import glfw
 import numpy as np
 from cython.operator cimport dereference as deref
+from libcpp.memory cimport shared_ptr
 from pyglui import ui
 from pyglui.cygl.utils import draw_gl_texture
 
 cimport detector
 from detector cimport *
 from detector_utils cimport *
-from coarse_pupil cimport center_surround
+from coarse_pupil cimport CoarsePupilDetector, CoarsePupilResult, convertCandidates
 from gl_utils import (
     adjust_gl_view,
     clear_gl_screen,
@@ -32,13 +33,22 @@ from gl_utils import (
     make_coord_system_pixel_based,
 )
 from methods import Roi, normalize
+from structured_result import (
+    BATCH_CHUNK_SIZE,
+    PUPIL_2D_DTYPE,
+    RESULT_RECORDS,
+    StructuredPupilResult,
+    frame_chunks,
+)
 from plugin import Plugin
 
 
 cdef class Detector_2D:
 
     cdef Detector2D* thisptr
+    cdef CoarsePupilDetector* coarseDetectorPtr
     cdef unsigned char[:,:,:] debugImage
+    cdef bint deferredVisualization
 
     cdef dict detectProperties
     cdef bint windowShouldOpen, windowShouldClose
@@ -53,8 +63,17 @@ cdef class Detector_2D:
     cdef int coarseDetectionPreviousWidth
     cdef object coarseDetectionPreviousPosition
 
+    # preallocated records of the structured results, see structured_result.py
+    cdef readonly object structured_records
+    cdef Pupil2DRecord[::1] records
+    cdef int recordIndex
+    cdef readonly object structured_sequences
+    cdef long long[::1] sequences
+    cdef long long recordSequence
+
     def __cinit__(self,g_pool = None, settings = None ):
         self.thisptr = new Detector2D()
+        self.coarseDetectorPtr = new CoarsePupilDetector()
     def __init__(self, g_pool = None, settings = None ):
         #debug window
         self._window = None
@@ -89,6 +108,19 @@ cdef class Detector_2D:
             self.detectProperties["final_perimeter_ratio_range_max"] = 1.0
             self.detectProperties["ellipse_true_support_min_dist"] = 3.0
             self.detectProperties["support_pixel_ratio_exponent"] = 2.0
+        # not present in settings stored by older versions
+        self.detectProperties.setdefault("collect_timings", False)
+        self.detectProperties.setdefault("tracking", False)
+        self.detectProperties.setdefault("tracking_window_scale", 2.0)
+        self.detectProperties.setdefault("pyramid_detection", False)
+
+        self.structured_records = np.zeros(RESULT_RECORDS, dtype=PUPIL_2D_DTYPE)
+        self.records = self.structured_records
+        self.recordIndex = 0
+        # the number of the detection which wrote each record, results check it to detect overwritten records
+        self.structured_sequences = np.zeros(RESULT_RECORDS, dtype=np.longlong)
+        self.sequences = self.structured_sequences
+        self.recordSequence = 0
 
     def get_settings(self):
         return self.detectProperties
@@ -100,14 +132,14 @@ cdef class Detector_2D:
 
     def __dealloc__(self):
       del self.thisptr
+      del self.coarseDetectorPtr
 
-    def detect(self, frame_, user_roi, visualize, pause_video = False ):
+    def detect(self, frame_, user_roi, visualize, pause_video = False, structured = False ):
 
         image_width = frame_.width
         image_height = frame_.height
 
-        cdef unsigned char[:,::1] img = frame_.gray
-        cdef Mat frame = Mat(image_height, image_width, CV_8UC1, <void *> &img[0,0] )
+        cdef Mat frame = luminanceMat(frame_)
 
         cdef unsigned char[:,:,:] img_color
         cdef Mat frameColor
@@ -126,8 +158,11 @@ cdef class Detector_2D:
             frameColor = Mat(image_height, image_width, CV_8UC3, <void *> &img_color[0,0,0] )
 
         if use_debugImage:
-            debugImage_array = np.zeros( (image_height, image_width, 3 ), dtype = np.uint8 ) #clear image every frame
-            self.debugImage = debugImage_array
+            # the image is kept and cleared every frame, only a new size allocates
+            if self.debugImage is None or self.debugImage.shape[0] != image_height or self.debugImage.shape[1] != image_width:
+                self.debugImage = np.zeros( (image_height, image_width, 3 ), dtype = np.uint8 )
+            else:
+                self.debugImage[:,:,:] = 0
             debugImage = Mat(image_height, image_width, CV_8UC3, <void *> &self.debugImage[0,0,0] )
 
         roi = Roi((0,0))
@@ -136,21 +171,22 @@ cdef class Detector_2D:
         roi_y = roi.get()[1]
         roi_width  = roi.get()[2] - roi.get()[0]
         roi_height  = roi.get()[3] - roi.get()[1]
-        cdef int[:,::1] integral
+        cdef CoarsePupilResult coarse_result
+        cdef Rect_[int] coarse_roi
+        cdef int scale, coarse_filter_min, coarse_filter_max
 
         if self.detectProperties['coarse_detection'] and roi_width*roi_height > 320*240:
-            scale = 2 # half the integral image. boost up integral
-            # TODO maybe implement our own Integral so we don't have to half the image
-            user_roi_image = frame_.gray[user_roi.view]
-            integral = cv2.integral(user_roi_image[::scale,::scale])
-            coarse_filter_max = self.detectProperties['coarse_filter_max']
-            coarse_filter_min = self.detectProperties['coarse_filter_min']
-            bounding_box , good_ones , bad_ones = center_surround( integral, coarse_filter_min/scale , coarse_filter_max/scale )
+            scale = 2 # the integral image is summed over every second pixel of the roi
+            coarse_filter_max = int(self.detectProperties['coarse_filter_max'])
+            coarse_filter_min = int(self.detectProperties['coarse_filter_min'])
+            coarse_roi = Rect_[int](roi_x,roi_y,roi_width,roi_height)
+            with nogil:
+                coarse_roi = self.coarseDetectorPtr.detect(frame, coarse_roi, coarse_filter_min, coarse_filter_max, scale, coarse_result)
 
             if visualize:
                 # !! uncomment this to visualize coarse detection
                 #  # draw the candidates
-                # for v  in bad_ones:
+                # for v  in convertCandidates(coarse_result.candidates):
                 #     p_x,p_y,w,response = v
                 #     x = p_x * scale + roi_x
                 #     y = p_y * scale + roi_y
@@ -158,7 +194,7 @@ cdef class Detector_2D:
                 #     cv2.rectangle( frame_.img , (x,y) , (x+width , y+width) , (0,0,255)  )
 
                 # # draw the candidates
-                for v  in good_ones:
+                for v  in convertCandidates(coarse_result.good):
                     p_x,p_y,w,response = v
                     x = p_x * scale + roi_x
                     y = p_y * scale + roi_y
@@ -170,23 +206,86 @@ cdef class Detector_2D:
                     #center = (int(x+width*0.5) , int(y+width*0.5))
                     #cv2.circle( frame_.img , center , 5 , (255,0,255) , -1  )
 
-            x1 , y1 , x2, y2 = bounding_box
-            width = x2 - x1
-            height = y2 - y1
-            roi_x = x1 * scale + roi_x
-            roi_y = y1 * scale + roi_y
-            roi_width = width*scale
-            roi_height = height*scale
+            roi_x = coarse_roi.x
+            roi_y = coarse_roi.y
+            roi_width = coarse_roi.width
+            roi_height = coarse_roi.height
             roi.set((roi_x, roi_y, roi_x+roi_width, roi_y+roi_height))
 
 
-        # every coordinates in the result are relative to the current ROI
-        cppResultPtr =  self.thisptr.detect(self.detectProperties, frame, frameColor, debugImage, Rect_[int](roi_x,roi_y,roi_width,roi_height),  visualize , use_debugImage )
+        cdef Detector2DProperties props = self.detectProperties
+        cdef Rect_[int] detection_roi = Rect_[int](roi_x,roi_y,roi_width,roi_height)
+        cdef bint c_visualize = visualize, c_use_debugImage = use_debugImage
+        cdef shared_ptr[Detector2DResult] cppResultPtr
 
-        py_result = convertTo2DPythonResult( deref(cppResultPtr), frame_ , roi )
+        # every coordinates in the result are relative to the current ROI
+        # the detection doesn't touch any python object, so other threads run meanwhile
+        with nogil:
+            cppResultPtr =  self.thisptr.detect(props, frame, frameColor, debugImage, detection_roi, c_visualize , c_use_debugImage )
+
+        cdef int record_index = self.recordIndex
+        if structured:
+            # the result is written into the next record, the dict is only built when it is used as one
+            self.recordIndex = (record_index + 1) % self.records.shape[0]
+            write2DRecord(&self.records[record_index], deref(cppResultPtr), image_width, image_height, frame_.timestamp)
+            self.recordSequence += 1
+            self.sequences[record_index] = self.recordSequence
+            extra = {'timings': convertTimings(deref(cppResultPtr).timings)} if self.detectProperties['collect_timings'] else None
+            return StructuredPupilResult(self.structured_records, self.structured_sequences, record_index, extra)
+
+        py_result = convertTo2DPythonResult( deref(cppResultPtr), frame_ , roi, self.detectProperties['collect_timings'] )
 
         return py_result
 
+    def detect_batch(self, frames, user_roi = None, segment_length = 0, chunk_size = BATCH_CHUNK_SIZE):
+        '''
+        Detects the pupil in a sequence of frames, e.g. for offline detection.
+        frames can be any iterable, it is read in chunks of chunk_size frames (whole segments), so only the images
+        of one chunk are kept at a time. The frames of a chunk are split into segments of segment_length consecutive
+        frames (by default one per thread), which are detected in parallel without the GIL.
+        Within a segment the strong prior carries over like online.
+        Returns a numpy array of PUPIL_2D_DTYPE records, one per frame, see structured_result.py.
+        '''
+        blocks = list(self.detect_batch_chunks(frames, user_roi, segment_length, chunk_size))
+        return np.concatenate(blocks) if blocks else np.zeros(0, dtype=PUPIL_2D_DTYPE)
+
+    def detect_batch_chunks(self, frames, user_roi = None, segment_length = 0, chunk_size = BATCH_CHUNK_SIZE):
+        '''
+        Same as detect_batch, but yields the records of every chunk as soon as it is detected, e.g. to write them out.
+        '''
+        for chunk in frame_chunks(frames, chunk_size, segment_length):
+            yield self.detect_chunk(chunk, user_roi, segment_length)
+
+    cdef detect_chunk(self, list frames, user_roi, int segment_length):
+        cdef vector[Detector2DResult] results
+        cdef Pupil2DRecord[::1] records
+        cdef size_t i
+
+        detect2DBatch(self.detectProperties, frames, user_roi, segment_length, results)
+
+        block = np.zeros(len(frames), dtype=PUPIL_2D_DTYPE)
+        records = block
+        for i in range(results.size()):
+            write2DRecord(&records[i], results[i], frames[i].width, frames[i].height, frames[i].timestamp)
+
+        return block
+
+    @property
+    def deferred_visualization(self):
+        return self.deferredVisualization
+
+    @deferred_visualization.setter
+    def deferred_visualization(self, deferred):
+        # detect only records the visualization, render_visualization draws it into the frame
+        self.deferredVisualization = deferred
+        self.thisptr.set_deferred_visualization(deferred)
+
+    def render_visualization(self, frame):
+        cdef unsigned char[:,:,:] img_color = frame.img
+        cdef Mat cv_image_color = Mat(frame.height, frame.width, CV_8UC3, <void *> &img_color[0,0,0] )
+        with nogil:
+            self.thisptr.render_visualization(cv_image_color)
+
     @property
     def pretty_class_name(self):
         return 'Pupil Detector 2D'
@@ -10,6 +10,7 @@ See COPYING and COPYING.LESSER for license details.
 """
 
 # cython: profile=False
+import logging
 import math
 from collections import namedtuple
 
@@ -17,13 +18,22 @@ import cv2
 import glfw
 import numpy as np
 from cython.operator cimport dereference as deref
+from libcpp.memory cimport shared_ptr
 from pyglui import ui
 from pyglui.cygl.utils import draw_gl_texture
 
-from coarse_pupil cimport center_surround
+from coarse_pupil cimport CoarsePupilDetector, CoarsePupilResult, convertCandidates
 from detector cimport *
 from detector_utils cimport *
+from native_log cimport drain_native_log
 from methods import Roi, normalize
+from structured_result import (
+    BATCH_CHUNK_SIZE,
+    PUPIL_3D_DTYPE,
+    RESULT_RECORDS,
+    StructuredPupilResult,
+    frame_chunks,
+)
 from gl_utils import (
     adjust_gl_view,
     clear_gl_screen,
@@ -34,15 +44,31 @@ from gl_utils import (
 from plugin import Plugin
 from visualizer_3d import Eye_Visualizer
 
+logger = logging.getLogger(__name__)
+
+cdef class OfflineFitter:
+    # the offline fit of one recording, it keeps the models of a chunk for the next one
+    cdef OfflineEyeModelFitter* thisptr
+
+    def __cinit__(self, double focal_length):
+        self.thisptr = new OfflineEyeModelFitter(focal_length)
+
+    def __dealloc__(self):
+        del self.thisptr
+
 
 cdef class Detector_3D:
 
     cdef Detector2D* detector2DPtr
+    cdef CoarsePupilDetector* coarseDetectorPtr
     cdef EyeModelFitter *detector3DPtr
+    cdef shared_ptr[ThreadPool] threadPool
+    cdef dict threadSettings
 
     cdef dict detectProperties2D, detectProperties3D
     cdef object debugVisualizer3D
     cdef object pyResult3D
+    cdef bint deferredVisualization
     cdef readonly object g_pool
     cdef readonly basestring uniqueness
     cdef public object menu
@@ -50,8 +76,17 @@ cdef class Detector_3D:
     cdef readonly basestring icon_chr
     cdef readonly basestring icon_font
 
+    # preallocated records of the structured results, see structured_result.py
+    cdef readonly object structured_records
+    cdef Pupil3DRecord[::1] records
+    cdef int recordIndex
+    cdef readonly object structured_sequences
+    cdef long long[::1] sequences
+    cdef long long recordSequence
+
     def __cinit__(self, g_pool = None, settings = None):
         self.detector2DPtr = new Detector2D()
+        self.coarseDetectorPtr = new CoarsePupilDetector()
         focal_length = 620.
         '''
         K for 30hz eye cam:
@@ -96,13 +131,65 @@ cdef class Detector_3D:
             self.detectProperties2D["final_perimeter_ratio_range_max"] = 1.2
             self.detectProperties2D["ellipse_true_support_min_dist"] = 2.5
             self.detectProperties2D["support_pixel_ratio_exponent"] = 2.0
+        # not present in settings stored by older versions
+        self.detectProperties2D.setdefault("collect_timings", False)
+        self.detectProperties2D.setdefault("tracking", False)
+        self.detectProperties2D.setdefault("tracking_window_scale", 2.0)
+        self.detectProperties2D.setdefault("pyramid_detection", False)
+
+        self.structured_records = np.zeros(RESULT_RECORDS, dtype=PUPIL_3D_DTYPE)
+        self.records = self.structured_records
+        self.recordIndex = 0
+        # the number of the detection which wrote each record, results check it to detect overwritten records
+        self.structured_sequences = np.zeros(RESULT_RECORDS, dtype=np.longlong)
+        self.sequences = self.structured_sequences
+        self.recordSequence = 0
 
 
         if not self.detectProperties3D:
             self.detectProperties3D["model_sensitivity"] = 0.997
 
+        thread_settings = settings.get('Thread_Settings', {}) if settings else {}
+        self.configure_threads(thread_settings.get('count', 0), thread_settings.get('cpus', ()), thread_settings.get('refinements', 2))
+
     def get_settings(self):
-        return {'2D_Settings': self.detectProperties2D , '3D_Settings' : self.detectProperties3D }
+        return {'2D_Settings': self.detectProperties2D , '3D_Settings' : self.detectProperties3D, 'Thread_Settings': self.threadSettings }
+
+    def configure_threads(self, int count = 0, cpus = (), int refinements = 2):
+        '''
+        The coarse detection, the evaluation of the 2D candidates and the model refinements can share a pool of count threads.
+        By default (count 0 without cpus) there is no pool: the 2D detection runs serially on the calling thread like before,
+        and the eye models refine themselves on at most refinements workers of the fitter. This is the safe default for the
+        eye processes, which run at the same time and would oversubscribe the cores with a pool of one thread per core each.
+        A negative count uses one thread per core. With cpus the threads only run on these cores, e.g. to keep the detectors
+        of both eyes on their own cores, count 0 then uses one thread per given core.
+        At most refinements eye models refine themselves at the same time.
+        '''
+        cdef vector[int] c_cpus = list(cpus)
+        cdef int threads = count if count != 0 else len(c_cpus)
+
+        if threads != 0:
+            self.threadPool = shared_ptr[ThreadPool](new ThreadPool(threads, c_cpus))
+        else:
+            self.threadPool.reset()
+
+        self.detector2DPtr.set_thread_pool(self.threadPool)
+        self.coarseDetectorPtr.set_thread_pool(self.threadPool)
+        self.detector3DPtr.setThreadPool(self.threadPool)
+        self.detector3DPtr.setMaxRefinements(refinements)
+        self.threadSettings = {'count': count, 'cpus': list(cpus), 'refinements': refinements}
+
+        if cpus and not self.threadPool.get().hasAffinity():
+            logger.warning('Could not run the pupil detection threads on cores {}'.format(list(cpus)))
+
+    def set_reproducible(self, bint reproducible):
+        '''
+        Reproducible detection measures time with the frame timestamps instead of the clock and refines the eye models
+        right away on the calling thread, like the offline fitting. A detector then gives the same results for the same
+        frames every time it runs in a new process. Live detection leaves it off, the refinements would delay the frames.
+        '''
+        self.detector3DPtr.setUseObservationTime(reproducible)
+        self.detector3DPtr.setBackgroundRefinement(not reproducible)
 
     def on_resolution_change(self, old_size, new_size):
         self.detectProperties2D["pupil_size_max"] *= new_size[0] / old_size[0]
@@ -110,16 +197,16 @@ cdef class Detector_3D:
 
     def __dealloc__(self):
       del self.detector2DPtr
+      del self.coarseDetectorPtr
       del self.detector3DPtr
 
-    def detect(self, frame, user_roi, visualize, pause = False ):
+    def detect(self, frame, user_roi, visualize, pause = False, structured = False ):
 
         image_width = frame.width
         image_height = frame.height
 
 
-        cdef unsigned char[:,::1] img = frame.gray
-        cdef Mat cv_image = Mat(image_height, image_width, CV_8UC1, <void *> &img[0,0] )
+        cdef Mat cv_image = luminanceMat(frame)
 
         cdef unsigned char[:,:,:] img_color
         cdef Mat cv_image_color
@@ -136,21 +223,22 @@ cdef class Detector_3D:
         roi_y = roi.get()[1]
         roi_width  = roi.get()[2] - roi.get()[0]
         roi_height  = roi.get()[3] - roi.get()[1]
-        cdef int[:,::1] integral
+        cdef CoarsePupilResult coarse_result
+        cdef Rect_[int] coarse_roi
+        cdef int scale, coarse_filter_min, coarse_filter_max
 
         if self.detectProperties2D['coarse_detection'] and roi_width*roi_height > 320*240:
-            scale = 2 # half the integral image. boost up integral
-            # TODO maybe implement our own Integral so we don't have to half the image
-            user_roi_image = frame.gray[user_roi.view]
-            integral = cv2.integral(user_roi_image[::scale,::scale])
-            coarse_filter_max = self.detectProperties2D['coarse_filter_max']
-            coarse_filter_min = self.detectProperties2D['coarse_filter_min']
-            bounding_box , good_ones , bad_ones = center_surround( integral, coarse_filter_min/scale , coarse_filter_max/scale )
+            scale = 2 # the integral image is summed over every second pixel of the roi
+            coarse_filter_max = int(self.detectProperties2D['coarse_filter_max'])
+            coarse_filter_min = int(self.detectProperties2D['coarse_filter_min'])
+            coarse_roi = Rect_[int](roi_x,roi_y,roi_width,roi_height)
+            with nogil:
+                coarse_roi = self.coarseDetectorPtr.detect(cv_image, coarse_roi, coarse_filter_min, coarse_filter_max, scale, coarse_result)
 
             if visualize:
                 # !! uncomment this to visualize coarse detection
                 #  # draw the candidates
-                # for v  in bad_ones:
+                # for v  in convertCandidates(coarse_result.candidates):
                 #     p_x,p_y,w,response = v
                 #     x = p_x * scale + roi_x
                 #     y = p_y * scale + roi_y
@@ -158,7 +246,7 @@ cdef class Detector_3D:
                 #     cv2.rectangle( frame.img , (x,y) , (x+width , y+width) , (0,0,255)  )
 
                 # # draw the candidates
-                for v  in good_ones:
+                for v  in convertCandidates(coarse_result.good):
                     p_x,p_y,w,response = v
                     x = p_x * scale + roi_x
                     y = p_y * scale + roi_y
@@ -171,35 +259,123 @@ cdef class Detector_3D:
                     #cv2.circle( frame.img , center , 5 , (255,0,255) , -1  )
 
 
-            x1 , y1 , x2, y2 = bounding_box
-            width = x2 - x1
-            height = y2 - y1
-            roi_x = x1 * scale + roi_x
-            roi_y = y1 * scale + roi_y
-            roi_width = width*scale
-            roi_height = height*scale
+            roi_x = coarse_roi.x
+            roi_y = coarse_roi.y
+            roi_width = coarse_roi.width
+            roi_height = coarse_roi.height
             roi.set((roi_x, roi_y, roi_x+roi_width, roi_y+roi_height))
 
+        cdef Detector2DProperties props2D = self.detectProperties2D
+        cdef Detector3DProperties props3D = self.detectProperties3D
+        cdef Rect_[int] detection_roi = Rect_[int](roi_x,roi_y,roi_width,roi_height)
+        cdef bint c_visualize = visualize
+        cdef shared_ptr[Detector2DResult] cpp2DResultPtr
+
         # every coordinates in the result are relative to the current ROI
-        cpp2DResultPtr =  self.detector2DPtr.detect(self.detectProperties2D, cv_image, cv_image_color, debug_image, Rect_[int](roi_x,roi_y,roi_width,roi_height), visualize , False ) #we don't use debug image in 3d model
+        # the detection doesn't touch any python object, so other threads run meanwhile
+        with nogil:
+            cpp2DResultPtr =  self.detector2DPtr.detect(props2D, cv_image, cv_image_color, debug_image, detection_roi, c_visualize , False ) #we don't use debug image in 3d model
 
         deref(cpp2DResultPtr).timestamp = frame.timestamp #timestamp doesn't get set elsewhere and it is needt in detector3D
 
         ######### 3D Model Part ############
         debugDetector =  self.debugVisualizer3D.window
-        cdef Detector3DResult cpp3DResult  = self.detector3DPtr.updateAndDetect( cpp2DResultPtr , self.detectProperties3D, debugDetector)
+        cdef bint c_debugDetector = bool(debugDetector)
+        cdef Detector3DResult cpp3DResult
 
-        pyResult = convertTo3DPythonResult(cpp3DResult , frame )
+        with nogil:
+            cpp3DResult = self.detector3DPtr.updateAndDetect( cpp2DResultPtr , props3D, c_debugDetector)
+
+        drain_native_log()
 
         if debugDetector:
             self.pyResult3D = prepareForVisualization3D(cpp3DResult)
 
+        cdef int record_index = self.recordIndex
+        if structured:
+            # the result is written into the next record, the dict is only built when it is used as one
+            self.recordIndex = (record_index + 1) % self.records.shape[0]
+            write3DRecord(&self.records[record_index], cpp3DResult, image_width, image_height, frame.timestamp)
+            self.recordSequence += 1
+            self.sequences[record_index] = self.recordSequence
+            extra = {'timings': convertTimings(deref(cpp2DResultPtr).timings)} if self.detectProperties2D['collect_timings'] else None
+            return StructuredPupilResult(self.structured_records, self.structured_sequences, record_index, extra)
+
+        pyResult = convertTo3DPythonResult(cpp3DResult , frame )
+
+        if self.detectProperties2D['collect_timings']:
+            pyResult['timings'] = convertTimings(deref(cpp2DResultPtr).timings)
+
         return pyResult
 
+    def detect_batch(self, frames, user_roi = None, segment_length = 0, warmup_length = 600, chunk_size = BATCH_CHUNK_SIZE):
+        '''
+        Detects the pupil and fits the eye model for a whole recording, e.g. for offline detection.
+        frames can be any iterable, it is read in chunks of chunk_size frames (whole segments), so only the images
+        of one chunk are kept at a time. The 2D detection and the model fitting run in parallel on segments of
+        consecutive frames, the model of a segment is warmed up on the warmup_length frames before it, also across
+        chunks. See OfflineEyeModelFitter.h.
+        The state of the online model is not touched.
+        Returns a numpy array of PUPIL_3D_DTYPE records, one per frame, see structured_result.py.
+        '''
+        blocks = list(self.detect_batch_chunks(frames, user_roi, segment_length, warmup_length, chunk_size))
+        return np.concatenate(blocks) if blocks else np.zeros(0, dtype=PUPIL_3D_DTYPE)
+
+    def detect_batch_chunks(self, frames, user_roi = None, segment_length = 0, warmup_length = 600, chunk_size = BATCH_CHUNK_SIZE):
+        '''
+        Same as detect_batch, but yields the records of every chunk as soon as it is fitted, e.g. to write them out.
+        '''
+        fitter = OfflineFitter(self.detector3DPtr.getFocalLength())
+        for chunk in frame_chunks(frames, chunk_size, segment_length):
+            yield self.detect_chunk(fitter, chunk, user_roi, segment_length, warmup_length)
+
+    cdef detect_chunk(self, OfflineFitter fitter, list frames, user_roi, int segment_length, int warmup_length):
+        cdef vector[Detector2DResult] results2D
+        cdef vector[Detector3DResult] results3D
+        cdef Detector3DProperties props3D = self.detectProperties3D
+        cdef OfflineFitterOptions options
+        cdef OfflineEyeModelFitter* cppFitter = fitter.thisptr
+        cdef Pupil3DRecord[::1] records
+        cdef size_t i
+
+        # the model is fitted to the edges, the chunks keep their memory bounded
+        detect2DBatch(self.detectProperties2D, frames, user_roi, 0, results2D, True)
+        for i in range(results2D.size()):
+            results2D[i].timestamp = frames[i].timestamp
+
+        options.segment_length = segment_length
+        options.warmup_length = warmup_length
+        options.merge_distance = 1.0
+        with nogil:
+            cppFitter.fit(results2D, props3D, options, results3D)
+
+        block = np.zeros(len(frames), dtype=PUPIL_3D_DTYPE)
+        records = block
+        for i in range(results3D.size()):
+            write3DRecord(&records[i], results3D[i], frames[i].width, frames[i].height, frames[i].timestamp)
+
+        return block
+
 
     def cleanup(self):
         self.debugVisualizer3D.close_window() # if we change detectors, be sure debug window is also closed
 
+    @property
+    def deferred_visualization(self):
+        return self.deferredVisualization
+
+    @deferred_visualization.setter
+    def deferred_visualization(self, deferred):
+        # detect only records the visualization, render_visualization draws it into the frame
+        self.deferredVisualization = deferred
+        self.detector2DPtr.set_deferred_visualization(deferred)
+
+    def render_visualization(self, frame):
+        cdef unsigned char[:,:,:] img_color = frame.img
+        cdef Mat cv_image_color = Mat(frame.height, frame.width, CV_8UC3, <void *> &img_color[0,0,0] )
+        with nogil:
+            self.detector2DPtr.render_visualization(cv_image_color)
+
     @property
     def pretty_class_name(self):
         return 'Pupil Detector 3D'
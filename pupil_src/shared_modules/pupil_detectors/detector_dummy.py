@@ -22,6 +22,9 @@ class Detector_Dummy(Plugin):
     def visualize(self):
         pass
 
+    def render_visualization(self, frame):
+        pass
+
     def get_settings(self):
         return {}
 
@@ -11,15 +11,17 @@ See COPYING and COPYING.LESSER for license details.
 
 # cython: profile=False
 from detector cimport *
+from libcpp.vector cimport vector
 from methods import  normalize
 from numpy.math cimport PI
+from libc.math cimport isnan
 
 cdef extern from 'singleeyefitter/mathHelper.h' namespace 'singleeyefitter::math':
 
     Matrix21d cart2sph( Matrix31d& m )
 
 
-cdef inline convertTo2DPythonResult( Detector2DResult& result, object frame, object roi ):
+cdef inline convertTo2DPythonResult( Detector2DResult& result, object frame, object roi, bint add_timings = False ):
 
 
     ellipse = {}
@@ -38,8 +40,27 @@ cdef inline convertTo2DPythonResult( Detector2DResult& result, object frame, obj
     py_result['timestamp'] = frame.timestamp
     py_result['method'] = '2d c++'
 
+    if add_timings:
+        py_result['timings'] = convertTimings(result.timings)
+
     return py_result
 
+cdef inline convertTimings( Detector2DTimings& timings ):
+
+    # stage durations of the 2D detection in milliseconds
+    py_timings = {}
+    py_timings['histogram'] = ticksToMilliseconds(timings.histogram)
+    py_timings['masks'] = ticksToMilliseconds(timings.masks)
+    py_timings['morphology_open'] = ticksToMilliseconds(timings.morphology_open)
+    py_timings['median_blur'] = ticksToMilliseconds(timings.median_blur)
+    py_timings['canny'] = ticksToMilliseconds(timings.canny)
+    py_timings['find_contours'] = ticksToMilliseconds(timings.find_contours)
+    py_timings['split_contours'] = ticksToMilliseconds(timings.split_contours)
+    py_timings['divide_contours'] = ticksToMilliseconds(timings.divide_contours)
+    py_timings['combinatorial_search'] = ticksToMilliseconds(timings.combinatorial_search)
+    py_timings['final_fitting'] = ticksToMilliseconds(timings.final_fitting)
+    return py_timings
+
 cdef inline convertTo3DPythonResult( Detector3DResult& result, object frame    ):
 
     #use negative z-coordinates to get from left-handed to right-handed coordinate system
@@ -97,6 +118,141 @@ cdef inline convertTo3DPythonResult( Detector3DResult& result, object frame    )
 
     return py_result
 
+# flat results, written into preallocated numpy records instead of building dicts
+# field order has to match PUPIL_2D_DTYPE and PUPIL_3D_DTYPE in structured_result.py
+cdef packed struct Pupil2DRecord:
+    double timestamp
+    double confidence
+    double diameter
+    double norm_pos_x, norm_pos_y
+    double ellipse_center_x, ellipse_center_y
+    double ellipse_minor_axis, ellipse_major_axis
+    double ellipse_angle
+
+cdef packed struct Pupil3DRecord:
+    double timestamp
+    double confidence
+    double diameter
+    double norm_pos_x, norm_pos_y
+    double ellipse_center_x, ellipse_center_y
+    double ellipse_minor_axis, ellipse_major_axis
+    double ellipse_angle
+    double diameter_3d
+    double circle_3d_center_x, circle_3d_center_y, circle_3d_center_z
+    double circle_3d_normal_x, circle_3d_normal_y, circle_3d_normal_z
+    double circle_3d_radius
+    double sphere_center_x, sphere_center_y, sphere_center_z
+    double sphere_radius
+    double projected_sphere_center_x, projected_sphere_center_y
+    double projected_sphere_minor_axis, projected_sphere_major_axis
+    double projected_sphere_angle
+    double model_confidence
+    double model_birth_timestamp
+    double theta, phi
+    int model_id
+
+# same values as convertTo2DPythonResult
+cdef inline void write2DRecord( Pupil2DRecord* record, Detector2DResult& result, int width, int height, double timestamp ):
+    record.timestamp = timestamp
+    record.confidence = result.confidence
+    record.ellipse_center_x = result.ellipse.center[0]
+    record.ellipse_center_y = result.ellipse.center[1]
+    record.ellipse_minor_axis = result.ellipse.minor_radius * 2.0
+    record.ellipse_major_axis = result.ellipse.major_radius * 2.0
+    record.ellipse_angle = result.ellipse.angle * 180.0 / PI - 90.0
+    record.diameter = max(record.ellipse_minor_axis, record.ellipse_major_axis)
+    record.norm_pos_x = record.ellipse_center_x / width
+    record.norm_pos_y = 1.0 - record.ellipse_center_y / height
+
+# same values as convertTo3DPythonResult
+cdef inline void write3DRecord( Pupil3DRecord* record, Detector3DResult& result, int width, int height, double timestamp ):
+    #use negative z-coordinates to get from left-handed to right-handed coordinate system
+    record.timestamp = timestamp
+    record.confidence = result.confidence
+    record.ellipse_center_x = result.ellipse.center[0] + width / 2.0
+    record.ellipse_center_y = height / 2.0 - result.ellipse.center[1]
+    record.ellipse_minor_axis = result.ellipse.minor_radius * 2.0
+    record.ellipse_major_axis = result.ellipse.major_radius * 2.0
+    record.ellipse_angle = - (result.ellipse.angle * 180.0 / PI - 90.0)
+    record.diameter = max(record.ellipse_minor_axis, record.ellipse_major_axis)
+    record.norm_pos_x = record.ellipse_center_x / width
+    record.norm_pos_y = 1.0 - record.ellipse_center_y / height
+
+    record.diameter_3d = result.circle.radius * 2.0
+    record.circle_3d_center_x = result.circle.center[0]
+    record.circle_3d_center_y = -result.circle.center[1]
+    record.circle_3d_center_z = result.circle.center[2]
+    record.circle_3d_normal_x = result.circle.normal[0]
+    record.circle_3d_normal_y = -result.circle.normal[1]
+    record.circle_3d_normal_z = result.circle.normal[2]
+    record.circle_3d_radius = result.circle.radius
+
+    record.sphere_center_x = result.sphere.center[0]
+    record.sphere_center_y = -result.sphere.center[1]
+    record.sphere_center_z = result.sphere.center[2]
+    record.sphere_radius = result.sphere.radius
+
+    if isnan(result.projectedSphere.center[0]):
+        record.projected_sphere_center_x = 0.0
+        record.projected_sphere_center_y = 0.0
+        record.projected_sphere_minor_axis = 0.0
+        record.projected_sphere_major_axis = 0.0
+        record.projected_sphere_angle = 90.0
+    else:
+        record.projected_sphere_center_x = result.projectedSphere.center[0] + width / 2.0
+        record.projected_sphere_center_y = height / 2.0 - result.projectedSphere.center[1]
+        record.projected_sphere_minor_axis = result.projectedSphere.minor_radius * 2.0
+        record.projected_sphere_major_axis = result.projectedSphere.major_radius * 2.0
+        record.projected_sphere_angle = - (result.projectedSphere.angle * 180.0 / PI - 90.0)
+
+    record.model_confidence = result.modelConfidence
+    record.model_id = result.modelID
+    record.model_birth_timestamp = result.modelBirthTimestamp
+
+    cdef Matrix21d coords = cart2sph(result.circle.normal)
+    if isnan(coords[0]):
+        record.theta = 0.0
+        record.phi = 0.0
+    else:
+        record.theta = coords[0]
+        record.phi = coords[1]
+
+# Wraps the luminance of a frame without copying it.
+# Frames can provide the Y plane of their decoded buffer as `luminance`, whose rows may be padded,
+# otherwise `gray` is used. The frame has to be kept alive as long as the Mat is used.
+cdef inline Mat luminanceMat( frame ) except *:
+    cdef unsigned char[:,:] plane
+    luminance = getattr(frame, 'luminance', None)
+    plane = frame.gray if luminance is None else luminance
+    if plane.strides[1] != 1:
+        raise ValueError('the pixels of a luminance row have to be contiguous')
+    return Mat(plane.shape[0], plane.shape[1], CV_8UC1, <void *> &plane[0,0], plane.strides[0])
+
+# 2D detection of a list of frames in parallel, used by the batch detection of both detectors
+# keep_edges keeps the edges of the results, which the 3D model fitting needs
+cdef inline detect2DBatch( dict properties, list frames, user_roi, int segment_length, vector[Detector2DResult]& results, bint keep_edges = False ):
+    cdef vector[Mat] cv_frames
+    cdef vector[Rect_[int]] rois
+    cdef Detector2DProperties props = properties
+    cdef Detector2DBatchOptions options
+
+    options.coarse_detection = properties['coarse_detection']
+    options.coarse_filter_min = int(properties['coarse_filter_min'])
+    options.coarse_filter_max = int(properties['coarse_filter_max'])
+    options.segment_length = segment_length
+    options.keep_edges = keep_edges
+
+    for frame in frames: # the frames keep their images alive during the detection
+        cv_frames.push_back(luminanceMat(frame))
+        if user_roi is None:
+            rois.push_back(Rect_[int](0, 0, frame.width, frame.height))
+        else:
+            lX, lY, uX, uY = user_roi.get()
+            rois.push_back(Rect_[int](lX, lY, uX - lX, uY - lY))
+
+    with nogil:
+        Detector2DBatch.detect(props, options, cv_frames, rois, results)
+
 cdef inline prepareForVisualization3D(  Detector3DResult& result ):
 
     py_visualizationResult = {}
@@ -0,0 +1,36 @@
+"""
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+"""
+
+import logging
+
+cdef extern from 'logger/ringlogger.h' namespace 'pupillabs':
+
+    cdef struct LogRecord:
+        int level
+        char name[32]
+        char message[220]
+
+    cdef cppclass LogRing:
+        @staticmethod
+        LogRing& instance()
+        bint pop( LogRecord& record ) nogil
+        size_t takeDropped() nogil
+
+
+cdef inline drain_native_log():
+    # forwards the records the C++ side logged since the last call to python logging
+    cdef LogRecord record
+    while LogRing.instance().pop(record):
+        logging.getLogger(record.name.decode()).log(record.level, record.message.decode(errors='replace'))
+
+    dropped = LogRing.instance().takeDropped()
+    if dropped:
+        logging.getLogger(__name__).warning('{} native log messages were dropped'.format(dropped))
@@ -38,6 +38,7 @@ dependencies = []
 for dirpath, dirnames, filenames in os.walk("singleeyefitter"):
     for filename in [f for f in filenames if f.endswith(".h")]:
         dependencies.append(os.path.join(dirpath, filename))
+dependencies += [f for f in os.listdir(".") if f.endswith(".hpp")]
 
 shared_cpp_include_path = "../../shared_cpp/include"
 singleeyefitter_include_path = "singleeyefitter/"
@@ -119,6 +120,7 @@ extensions = [
             "singleeyefitter/ImageProcessing/cvx.cpp",
             "singleeyefitter/utils.cpp",
             "singleeyefitter/detectorUtils.cpp",
+            "singleeyefitter/ThreadPool.cpp",
         ],
         include_dirs=include_dirs,
         libraries=libs,
@@ -143,6 +145,9 @@ extensions = [
             "singleeyefitter/detectorUtils.cpp",
             "singleeyefitter/EyeModelFitter.cpp",
             "singleeyefitter/EyeModel.cpp",
+            "singleeyefitter/OfflineEyeModelFitter.cpp",
+            "singleeyefitter/ThreadPool.cpp",
+            "singleeyefitter/RefinementExecutor.cpp",
         ],
         include_dirs=include_dirs,
         libraries=libs,
@@ -0,0 +1,127 @@
+#ifndef singleeyefitter_bitsetlist_h__
+#define singleeyefitter_bitsetlist_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace singleeyefitter {
+
+    // List of bitsets which all have the same runtime width, stored in one flat vector of 64 bit words.
+    // Used for sets of contour indices, where subset tests and unions become a few word operations.
+    class BitsetList {
+        public:
+            typedef uint64_t Word;
+
+            BitsetList() : mWords(0) {};
+
+            // removes all bitsets and sets the width for the following ones
+            void reset(int bits)
+            {
+                mWords = (bits + 63) / 64;
+                mData.clear();
+            }
+
+            size_t size() const { return mWords == 0 ? 0 : mData.size() / mWords; }
+            bool empty() const { return mData.empty(); }
+            int words() const { return mWords; }
+
+            Word* operator[](size_t i) { return mData.data() + i * mWords; }
+            const Word* operator[](size_t i) const { return mData.data() + i * mWords; }
+            Word* back() { return mData.data() + mData.size() - mWords; }
+
+            // appends an empty bitset and returns it
+            Word* push_back()
+            {
+                mData.resize(mData.size() + mWords, 0);
+                return back();
+            }
+
+            // appends a copy of bitset, which must not point into this list
+            Word* push_back(const Word* bitset)
+            {
+                mData.insert(mData.end(), bitset, bitset + mWords);
+                return back();
+            }
+
+            void pop_back() { mData.resize(mData.size() - mWords); }
+
+            // true if one of the bitsets in the list is a subset of bitset
+            bool containsSubsetOf(const Word* bitset) const
+            {
+                for (size_t i = 0; i < mData.size(); i += mWords) {
+                    if (isSubset(mData.data() + i, bitset, mWords))
+                        return true;
+                }
+
+                return false;
+            }
+
+            static void set(Word* bitset, int bit) { bitset[bit / 64] |= Word(1) << (bit % 64); }
+
+            // true if every bit of a is set in b as well
+            static bool isSubset(const Word* a, const Word* b, int words)
+            {
+                for (int w = 0; w < words; w++) {
+                    if (a[w] & ~b[w])
+                        return false;
+                }
+
+                return true;
+            }
+
+            // calls f with the index of every set bit, in increasing order
+            template<typename Function>
+            static void forEachBit(const Word* bitset, int words, Function f)
+            {
+                for (int w = 0; w < words; w++) {
+                    Word word = bitset[w];
+
+                    while (word) {
+                        f(w * 64 + lowestBit(word));
+                        word &= word - 1;
+                    }
+                }
+            }
+
+            static int lowestBit(Word word)
+            {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+                unsigned long index;
+                _BitScanForward64(&index, word);
+                return int(index);
+#elif defined(_MSC_VER)
+                // _BitScanForward64 only exists on 64 bit targets, scan the two halves instead
+                unsigned long index;
+
+                if (_BitScanForward(&index, static_cast<unsigned long>(word)))
+                    return int(index);
+
+                _BitScanForward(&index, static_cast<unsigned long>(word >> 32));
+                return int(index) + 32;
+#elif defined(__GNUC__)
+                return __builtin_ctzll(word);
+#else
+                int index = 0;
+
+                while (!(word & 1)) {
+                    word >>= 1;
+                    index++;
+                }
+
+                return index;
+#endif
+            }
+
+        private:
+            int mWords;
+            std::vector<Word> mData;
+    };
+
+} // namespace singleeyefitter
+
+#endif // singleeyefitter_bitsetlist_h__
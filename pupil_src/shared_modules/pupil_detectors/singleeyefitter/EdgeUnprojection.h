@@ -0,0 +1,112 @@
+#ifndef singleeyefitter_edgeunprojection_h__
+#define singleeyefitter_edgeunprojection_h__
+
+#include <Eigen/Core>
+
+#include <vector>
+
+#include "common/types.h"
+
+namespace singleeyefitter {
+
+    // Unprojects batches of image points onto the eye sphere, the front intersection of each camera ray with the sphere
+    // like intersect(Line3, Sphere, pair&).
+    //
+    // The points are processed as structure of arrays, so Eigen can vectorize the whole batch. The buffers only grow
+    // and the batch is a view of its first count elements, so unprojecting the edges of a frame doesn't allocate once
+    // the buffers are large enough, no matter how the number of edges changes from frame to frame.
+    class EdgeUnprojection {
+        public:
+
+            typedef Eigen::Array<double, Eigen::Dynamic, 1> Coordinates;
+            typedef Eigen::Array<unsigned char, Eigen::Dynamic, 1> Mask; // 1 if the point is on the sphere
+            typedef Eigen::Map<const Coordinates> CoordinatesView;
+            typedef Eigen::Map<const Mask> MaskView;
+
+            EdgeUnprojection() : mCount(0) {};
+
+            // x and y are image coordinates of count points, relative to the principal point
+            void unproject(const double* x, const double* y, int count, const Vector3& cameraCenter, double focalLength, const Sphere<double>& sphere)
+            {
+                typedef Eigen::Map<const Coordinates> Input;
+
+                mCount = count;
+                Eigen::Map<Coordinates> X = view(mX, count), Y = view(mY, count), Z = view(mZ, count);
+                Eigen::Map<Coordinates> scale = view(mScale, count), discriminant = view(mDiscriminant, count);
+                Eigen::Map<Mask> valid = view(mValid, count);
+
+                // normalized ray directions
+                X = Input(x, count) - cameraCenter.x();
+                Y = Input(y, count) - cameraCenter.y();
+                const double dz = focalLength - cameraCenter.z();
+                scale = (X.square() + Y.square() + dz * dz).rsqrt();
+                X *= scale;
+                Y *= scale;
+                Z = dz * scale;
+
+                // s = v.c -+ sqrt((v.c)^2 - c.c + r^2), with c relative to the camera center
+                const Vector3 c = sphere.center - cameraCenter;
+                scale = X * c.x() + Y * c.y() + Z * c.z(); // v.c
+                discriminant = scale.square() - c.squaredNorm() + sphere.radius * sphere.radius;
+                valid = (discriminant >= 0.0).cast<unsigned char>();
+                scale -= (discriminant >= 0.0).select(discriminant, 0.0).sqrt();
+
+                X = X * scale + cameraCenter.x();
+                Y = Y * scale + cameraCenter.y();
+                Z = Z * scale + cameraCenter.z();
+            }
+
+            void unproject(const Edges2D& edges, const Vector3& cameraCenter, double focalLength, const Sphere<double>& sphere)
+            {
+                const int count = edges.size();
+                Eigen::Map<Coordinates> u = view(mU, count), v = view(mV, count);
+
+                for (int i = 0; i < count; i++) {
+                    u[i] = edges[i].x;
+                    v[i] = edges[i].y;
+                }
+
+                unproject(u.data(), v.data(), count, cameraCenter, focalLength, sphere);
+            }
+
+            // points of the last batch, only the ones with valid() set are on the sphere
+            int size() const { return mCount; };
+            CoordinatesView x() const { return CoordinatesView(mX.data(), mCount); };
+            CoordinatesView y() const { return CoordinatesView(mY.data(), mCount); };
+            CoordinatesView z() const { return CoordinatesView(mZ.data(), mCount); };
+            MaskView valid() const { return MaskView(mValid.data(), mCount); };
+
+            // replaces edges with the valid points of the last batch, in the order of the batch
+            void validPoints(Edges3D& edges) const
+            {
+                edges.clear();
+                edges.reserve(mCount);
+
+                for (int i = 0; i < mCount; i++) {
+                    if (mValid[i])
+                        edges.emplace_back(mX[i], mY[i], mZ[i]);
+                }
+            }
+
+        private:
+
+            std::vector<double> mU, mV;
+            std::vector<double> mX, mY, mZ;
+            std::vector<double> mScale, mDiscriminant;
+            std::vector<unsigned char> mValid;
+            int mCount;
+
+            // the first count elements of buffer, which only grows
+            template<typename Scalar>
+            static Eigen::Map<Eigen::Array<Scalar, Eigen::Dynamic, 1>> view(std::vector<Scalar>& buffer, int count)
+            {
+                if (buffer.size() < size_t(count))
+                    buffer.resize(count);
+
+                return Eigen::Map<Eigen::Array<Scalar, Eigen::Dynamic, 1>>(buffer.data(), count);
+            }
+    };
+
+} // namespace singleeyefitter
+
+#endif // singleeyefitter_edgeunprojection_h__
@@ -2,9 +2,24 @@
 #define singleeyefitter_ellipsedistanceapproxcalculator_h__
 
 
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#include <opencv2/core.hpp>
+
 #include "common/traits.h"
 #include "mathHelper.h"
 
+// batch evaluation uses the widest instruction set the compiler targets
+#if defined(__AVX2__)
+#define SINGLEEYEFITTER_ELLIPSE_DISTANCE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SINGLEEYEFITTER_ELLIPSE_DISTANCE_SSE2
+#include <emmintrin.h>
+#endif
+
 // Calculates:
 //     r * (1 - ||A(p - t)||)
 //
@@ -13,6 +28,10 @@
 // r * (1 - ||A(p - t)||)  scales this to major radius of ellipse, for (roughly) pixel distance
 //
 // Actually use (r - ||rAp - rAt||) and precalculate r, rA and rAt.
+//
+// batch() evaluates whole point arrays at once (only for T = double), with AVX2 or SSE2 if available.
+// setup.py doesn't pass -mavx2, so the extension uses the SSE2 kernel on x86-64, the AVX2 kernel is only
+// compiled if the compiler targets AVX2. Both give the same distances as operator(), see Tests/EllipseDistanceBatchTest.
 
 namespace singleeyefitter {
 
@@ -77,7 +96,113 @@ namespace singleeyefitter {
                 T xy_dist = norm(rAxt, rAyt);
                 return (r - xy_dist);
             }
+
+            struct BatchResult {
+                double squared_sum; // sum of the squared distances
+                size_t inlier_count; // points with an absolute distance <= threshold
+            };
+
+            // Evaluates count points given as int arrays, the coordinates of point i are x[i * stride] and y[i * stride].
+            // For a std::vector<cv::Point> use &points[0].x, &points[0].y and a stride of 2.
+            // The signed distances are written to distances, if it is not null.
+            BatchResult batch(const int* x, const int* y, size_t count, size_t stride, double threshold, double* distances = nullptr) const
+            {
+                static_assert(std::is_same<T, double>::value, "batch evaluation is only implemented for double");
+                const double a00 = rA(0, 0), a01 = rA(0, 1), a10 = rA(1, 0), a11 = rA(1, 1);
+                const double t0 = rAt[0], t1 = rAt[1];
+                BatchResult result = {0.0, 0};
+                size_t i = 0;
+
+#if defined(SINGLEEYEFITTER_ELLIPSE_DISTANCE_AVX2)
+                const __m256d va00 = _mm256_set1_pd(a00), va01 = _mm256_set1_pd(a01);
+                const __m256d va10 = _mm256_set1_pd(a10), va11 = _mm256_set1_pd(a11);
+                const __m256d vt0 = _mm256_set1_pd(t0), vt1 = _mm256_set1_pd(t1);
+                const __m256d vr = _mm256_set1_pd(r), vthreshold = _mm256_set1_pd(threshold);
+                const __m256d sign_mask = _mm256_set1_pd(-0.0);
+                __m256d vsum = _mm256_setzero_pd();
+
+                for (; i + 4 <= count; i += 4) {
+                    const __m256d vx = _mm256_cvtepi32_pd(_mm_set_epi32(x[(i + 3) * stride], x[(i + 2) * stride], x[(i + 1) * stride], x[i * stride]));
+                    const __m256d vy = _mm256_cvtepi32_pd(_mm_set_epi32(y[(i + 3) * stride], y[(i + 2) * stride], y[(i + 1) * stride], y[i * stride]));
+                    const __m256d ux = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(va00, vx), _mm256_mul_pd(va01, vy)), vt0);
+                    const __m256d uy = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(va10, vx), _mm256_mul_pd(va11, vy)), vt1);
+                    const __m256d d = _mm256_sub_pd(vr, _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(ux, ux), _mm256_mul_pd(uy, uy))));
+                    vsum = _mm256_add_pd(vsum, _mm256_mul_pd(d, d));
+                    result.inlier_count += bitCount(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_andnot_pd(sign_mask, d), vthreshold, _CMP_LE_OQ)));
+
+                    if (distances)
+                        _mm256_storeu_pd(distances + i, d);
+                }
+
+                double lanes[4];
+                _mm256_storeu_pd(lanes, vsum);
+                result.squared_sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(SINGLEEYEFITTER_ELLIPSE_DISTANCE_SSE2)
+                const __m128d va00 = _mm_set1_pd(a00), va01 = _mm_set1_pd(a01);
+                const __m128d va10 = _mm_set1_pd(a10), va11 = _mm_set1_pd(a11);
+                const __m128d vt0 = _mm_set1_pd(t0), vt1 = _mm_set1_pd(t1);
+                const __m128d vr = _mm_set1_pd(r), vthreshold = _mm_set1_pd(threshold);
+                const __m128d sign_mask = _mm_set1_pd(-0.0);
+                __m128d vsum = _mm_setzero_pd();
+
+                for (; i + 2 <= count; i += 2) {
+                    const __m128d vx = _mm_cvtepi32_pd(_mm_set_epi32(0, 0, x[(i + 1) * stride], x[i * stride]));
+                    const __m128d vy = _mm_cvtepi32_pd(_mm_set_epi32(0, 0, y[(i + 1) * stride], y[i * stride]));
+                    const __m128d ux = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(va00, vx), _mm_mul_pd(va01, vy)), vt0);
+                    const __m128d uy = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(va10, vx), _mm_mul_pd(va11, vy)), vt1);
+                    const __m128d d = _mm_sub_pd(vr, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(ux, ux), _mm_mul_pd(uy, uy))));
+                    vsum = _mm_add_pd(vsum, _mm_mul_pd(d, d));
+                    result.inlier_count += bitCount(_mm_movemask_pd(_mm_cmple_pd(_mm_andnot_pd(sign_mask, d), vthreshold)));
+
+                    if (distances)
+                        _mm_storeu_pd(distances + i, d);
+                }
+
+                double lanes[2];
+                _mm_storeu_pd(lanes, vsum);
+                result.squared_sum = lanes[0] + lanes[1];
+#endif
+
+                for (; i < count; i++) {
+                    const double px = x[i * stride];
+                    const double py = y[i * stride];
+                    const double ux = (a00 * px + a01 * py) - t0;
+                    const double uy = (a10 * px + a11 * py) - t1;
+                    const double d = r - std::sqrt(ux * ux + uy * uy);
+                    result.squared_sum += d * d;
+
+                    if (std::abs(d) <= threshold)
+                        result.inlier_count++;
+
+                    if (distances)
+                        distances[i] = d;
+                }
+
+                return result;
+            }
+
+            BatchResult batch(const std::vector<cv::Point>& points, double threshold, double* distances = nullptr) const
+            {
+                if (points.empty()) {
+                    BatchResult empty = {0.0, 0};
+                    return empty;
+                }
+
+                return batch(&points[0].x, &points[0].y, points.size(), 2, threshold, distances);
+            }
+
         private:
+            static size_t bitCount(int mask)
+            {
+                size_t count = 0;
+
+                for (; mask; mask &= mask - 1) {
+                    count++;
+                }
+
+                return count;
+            }
+
             Eigen::Matrix<T, 2, 2> rA;
             Eigen::Matrix<T, 2, 1> rAt;
             T r;
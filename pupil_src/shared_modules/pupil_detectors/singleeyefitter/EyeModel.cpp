@@ -77,6 +77,7 @@ EyeModel::EyeModel( int modelId, double timestamp,  double focalLength, Vector3
     mInitialUncheckedPupils(initialUncheckedPupils),
     mTotalBins(std::pow(std::floor(1.0/binResolution), 2 ) * 4 ),
     mBinResolution(binResolution),
+    mUseObservationTime(false),
     mSolverFit(0),
     mPerformance(30),
     mPerformanceGradient(0),
@@ -87,9 +88,22 @@ EyeModel::EyeModel( int modelId, double timestamp,  double focalLength, Vector3
 
 EyeModel::~EyeModel(){
 
-    //wait for thread to finish before we dealloc
-    if( mWorker.joinable() )
-        mWorker.join();
+    //wait for the refinement to finish before we dealloc
+    if( mRefinementExecutor )
+        mRefinementExecutor->cancel(this);
+}
+
+void EyeModel::setRefinementExecutor( std::shared_ptr<RefinementExecutor> executor )
+{
+    if( mRefinementExecutor )
+        mRefinementExecutor->cancel(this);
+
+    mRefinementExecutor = std::move(executor);
+}
+
+Clock::time_point EyeModel::currentTime( double timestamp ) const
+{
+    return mUseObservationTime ? timestampToTimePoint(timestamp) : Clock::now();
 }
 
 
@@ -100,6 +114,8 @@ std::pair<Circle,ConfidenceValue> EyeModel::presentObservation(const Observation
         mBirthTimestamp = newObservationPtr->getObservation2D()->timestamp;
         }
 
+    const Clock::time_point now = currentTime(newObservationPtr->getObservation2D()->timestamp);
+
     Circle circle;
     bool shouldAddObservation = false;
     double confidence2D = newObservationPtr->getObservation2D()->confidence;
@@ -118,7 +134,7 @@ std::pair<Circle,ConfidenceValue> EyeModel::presentObservation(const Observation
 
         if (unprojectedCircle != Circle::Null && circle != Circle::Null) {  // initialise failed
             oberservation_fit = calculateModelOberservationFit(unprojectedCircle, circle , confidence2D);
-            updatePerformance( oberservation_fit, averageFramerate);
+            updatePerformance( oberservation_fit, averageFramerate, now);
         }
 
         if (circle == Circle::Null){
@@ -148,7 +164,6 @@ std::pair<Circle,ConfidenceValue> EyeModel::presentObservation(const Observation
 
     using namespace std::chrono;
 
-    Clock::time_point now( Clock::now() );
     seconds pastSecondsRefinement = duration_cast<seconds>(now - mLastModelRefinementTime);
 
     int amountNewObservations = mSupportingPupilsToAdd.size();
@@ -156,7 +171,7 @@ std::pair<Circle,ConfidenceValue> EyeModel::presentObservation(const Observation
 
             if(tryTransferNewObservations() ) {
 
-                auto work = [&](){
+                auto work = [this](){
                     std::lock_guard<std::mutex> lockPupil(mPupilMutex);
                     auto sphere  = initialiseModel();
                     auto sphere2 = sphere;
@@ -168,13 +183,12 @@ std::pair<Circle,ConfidenceValue> EyeModel::presentObservation(const Observation
                         mSolverFit = fit;
                     }
                  };
-                // needed in order to assign a new thread
-                if( mWorker.joinable() )
-                    mWorker.join(); // we should never wait here because tryTransferNewObservations is false if the work isn't finished
-
-                mLastModelRefinementTime =  Clock::now() ;
-                mWorker = std::thread(work);
-                //work();
+                mLastModelRefinementTime =  now ;
+                // tryTransferNewObservations is false while the refinement runs, a pending one is replaced
+                if( mRefinementExecutor )
+                    mRefinementExecutor->submit(this, work);
+                else
+                    work();
             }
      }
 
@@ -548,7 +562,7 @@ ConfidenceValue EyeModel::calculateModelOberservationFit(const Circle&  unprojec
     return oberservationFit;
 }
 
-void EyeModel::updatePerformance( const ConfidenceValue& performance_datum, double averageFramerate ){
+void EyeModel::updatePerformance( const ConfidenceValue& performance_datum, double averageFramerate, Clock::time_point now ){
 
     // dont add values with 0.0 confidence.
     if( performance_datum.value <= 0.0 )
@@ -568,7 +582,6 @@ void EyeModel::updatePerformance( const ConfidenceValue& performance_datum, doub
 
     using namespace std::chrono;
 
-    Clock::time_point now( Clock::now() );
     duration<double, std::milli> deltaTimeMs = now - mLastPerformanceCalculationTime;
     // calculate performance gradient (backward difference )
     mPerformanceGradient =  (mPerformance.getAverage() - previousPerformance) / deltaTimeMs.count();
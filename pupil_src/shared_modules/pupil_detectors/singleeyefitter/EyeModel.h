@@ -3,7 +3,8 @@
 
 #include "common/types.h"
 #include "mathHelper.h"
-#include <thread>
+#include "RefinementExecutor.h"
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <vector>
@@ -90,6 +91,11 @@ class EyeModel {
         int getModelID() const { return mModelID; };
         double getBirthTimestamp() const { return mBirthTimestamp; };
 
+        // refinements are queued on executor, without one they run right away
+        void setRefinementExecutor( std::shared_ptr<RefinementExecutor> executor );
+        // measure time with the timestamps of the observations instead of the clock, for offline fitting
+        void setUseObservationTime( bool use ){ mUseObservationTime = use; };
+
         // ----- Visualization --------
         std::vector<Vector3> getBinPositions() const {return mBinPositions;};
         // ----- Visualization END --------
@@ -117,7 +123,8 @@ class EyeModel {
         bool tryTransferNewObservations();
 
         ConfidenceValue calculateModelOberservationFit(const Circle&  unprojectedCircle, const Circle& initialisedCircle, double confidence) const;
-        void updatePerformance( const ConfidenceValue& observation_fit,  double averageFramerate);
+        void updatePerformance( const ConfidenceValue& observation_fit,  double averageFramerate, Clock::time_point now);
+        Clock::time_point currentTime( double timestamp ) const;
 
         double calculateModelFit(const Circle&  unprojectedCircle, const Circle& optimizedCircle) const;
         bool isSpatialRelevant(const Circle& circle);
@@ -136,8 +143,9 @@ class EyeModel {
 
         mutable std::mutex mModelMutex;
         std::mutex mPupilMutex;
-        std::thread mWorker;
+        std::shared_ptr<RefinementExecutor> mRefinementExecutor;
         Clock::time_point mLastModelRefinementTime;
+        bool mUseObservationTime;
 
 
         // Factors which describe how good certain properties of the model are
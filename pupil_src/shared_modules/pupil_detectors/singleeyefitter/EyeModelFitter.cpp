@@ -3,6 +3,9 @@
 #include "CircleDeviationVariance3D.h"
 #include "CircleEvaluation3D.h"
 #include "CircleGoodness3D.h"
+#include "EdgeUnprojection.h"
+#include "GridSearch.h"
+#include "SphericalEdgeIndex.h"
 
 #include "utils.h"
 #include "ImageProcessing/cvx.h"
@@ -26,15 +29,17 @@ EyeModelFitter::EyeModelFitter(double focalLength, Vector3 cameraCenter) :
     mCameraCenter(std::move(cameraCenter)),
     mCurrentSphere(Sphere::Null), mCurrentInitialSphere(Sphere::Null),
     mNextModelID(1),
-    mActiveModelPtr(new EyeModel(mNextModelID, -1, mFocalLength, mCameraCenter)),
+    mRefinementExecutor(std::make_shared<RefinementExecutor>()),
     mLastTimeModelAdded( Clock::now() ),
+    mUseObservationTime(false),
+    mBackgroundRefinement(true),
     mApproximatedFramerate(30),
     mAverageFramerate(400), // windowsize is 400, let this be slow to changes to better compensate jumps
     mLastFrameTimestamp(0),
-    mPupilState(7,3,0, CV_64F),
-    mLogger( pupillabs::PyCppLogger("EyeModelFitter"))
+    mLogger("EyeModelFitter")
 
 {
+    mActiveModelPtr = createModel(-1);
     mNextModelID++;
 
     // our model for the kalman filter
@@ -49,17 +54,19 @@ EyeModelFitter::EyeModelFitter(double focalLength, Vector3 cameraCenter) :
     // 0x + 0y + 0vx + 0vy + 0ax + 1ay + 0size= ay
     // 0x + 0y + 0vx + 0vy + 0ax + 0ay + 1size  = size
 
-    mPupilState.measurementMatrix = (cv::Mat_<double>(3, 7) <<  1, 0, 0, 0, 0, 0, 0,
-                                                                0, 1, 0, 0, 0, 0, 0,
-                                                                0, 0, 0, 0, 0, 0, 1);
+    mPupilState.measurementMatrix <<  1, 0, 0, 0, 0, 0, 0,
+                                      0, 1, 0, 0, 0, 0, 0,
+                                      0, 0, 0, 0, 0, 0, 1;
 
-    cv::setIdentity(mPupilState.processNoiseCov, cv::Scalar::all(1e-4));
-    cv::setIdentity(mPupilState.errorCovPost, cv::Scalar::all(1));
+    mPupilState.processNoiseCov.setIdentity();
+    mPupilState.processNoiseCov *= 1e-4;
+    mPupilState.errorCov.setIdentity();
 
-    cv::setIdentity(mPupilState.measurementNoiseCov, cv::Scalar::all(1e-5));
-    mPupilState.measurementNoiseCov.at<double>(2,2) =  0.1; // circle size has a different variance
+    mPupilState.measurementNoiseCov.setIdentity();
+    mPupilState.measurementNoiseCov *= 1e-5;
+    mPupilState.measurementNoiseCov(2,2) =  0.1; // circle size has a different variance
 
-    mPupilState.statePost.at<double>(6) = 2.0;  //initialise the size value with the average pupil radius
+    mPupilState.state(6) = 2.0;  //initialise the size value with the average pupil radius
 
 }
 
@@ -78,6 +85,8 @@ Detector3DResult EyeModelFitter::updateAndDetect(std::shared_ptr<Detector2DResul
     if( mLastFrameTimestamp != 0.0 ){
         mApproximatedFramerate =  static_cast<int>(1.0 / (  deltaTime ));
         mAverageFramerate.addValue(mApproximatedFramerate);
+    }else if( mUseObservationTime ){
+        mLastTimeModelAdded = currentTime(observation2D->timestamp); // like the clock starts with the fitter
     }
     mLastFrameTimestamp = observation2D->timestamp;
 
@@ -262,7 +271,7 @@ void EyeModelFitter::checkModels( float sensitivity,double frame_timestamp )
     static const seconds minNewModelTime(3);
     static const double gradientChangeThreshold = -2.0e-05; // with this we are also sensitive to changes even if the performance is still above the threshold
 
-    Clock::time_point  now( Clock::now() );
+    Clock::time_point  now( currentTime(frame_timestamp) );
 
     /* whenever our current model's performance is below the threshold or the performance decreases rapidly (performance gradient)
        we try to create an alternative model
@@ -277,7 +286,8 @@ void EyeModelFitter::checkModels( float sensitivity,double frame_timestamp )
             mActiveModelPtr->getMaturity() > minMaturity &&
             lastTimeAdded  > minNewModelTime )
         {
-            mAlternativeModelsPtrs.emplace_back(  new EyeModel(mNextModelID , frame_timestamp, mFocalLength, mCameraCenter ) );
+            mAlternativeModelsPtrs.push_back( createModel(frame_timestamp) );
+            mLogger.debug("Model %d performs badly, added alternative model %d", mActiveModelPtr->getModelID(), mNextModelID);
             mNextModelID++;
             mLastTimeModelAdded = now;
         }
@@ -302,6 +312,7 @@ void EyeModelFitter::checkModels( float sensitivity,double frame_timestamp )
     for( auto& modelptr : mAlternativeModelsPtrs){
 
         if(modelptr->getMaturity() > minMaturity &&  mActiveModelPtr->getPerformance() < modelptr->getPerformance() ){
+            mLogger.debug("Switched from model %d to better model %d", mActiveModelPtr->getModelID(), modelptr->getModelID());
             mActiveModelPtr.reset( modelptr.release() );
             mAlternativeModelsPtrs.clear(); // we got a better one, let's remove others
             foundNew = true;
@@ -314,24 +325,68 @@ void EyeModelFitter::checkModels( float sensitivity,double frame_timestamp )
     if( !foundNew && lastPenalty > altModelExpirationTime ){
 
         mAlternativeModelsPtrs.clear();
-        mActiveModelPtr.reset(  new EyeModel(mNextModelID , frame_timestamp, mFocalLength, mCameraCenter ));
+        mActiveModelPtr = createModel(frame_timestamp);
+        mLogger.debug("No better alternative model found, started over with model %d", mNextModelID);
         mNextModelID++;
     }
 
 
 }
 
+void EyeModelFitter::setThreadPool( std::shared_ptr<ThreadPool> pool )
+{
+    mThreadPool = std::move(pool);
+    mRefinementExecutor->setThreadPool(mThreadPool);
+}
+
+void EyeModelFitter::setMaxRefinements( int count )
+{
+    mRefinementExecutor->setMaxConcurrency(count);
+}
+
+void EyeModelFitter::setBackgroundRefinement( bool enabled )
+{
+    mBackgroundRefinement = enabled;
+    const auto executor = enabled ? mRefinementExecutor : nullptr;
+    mActiveModelPtr->setRefinementExecutor(executor);
+    for( auto& model : mAlternativeModelsPtrs )
+        model->setRefinementExecutor(executor);
+}
+
+void EyeModelFitter::setUseObservationTime( bool use )
+{
+    mUseObservationTime = use;
+    mActiveModelPtr->setUseObservationTime(use);
+    for( auto& model : mAlternativeModelsPtrs )
+        model->setUseObservationTime(use);
+
+    // like a model was added with the last observation, the first observation starts the time otherwise
+    mLastTimeModelAdded = currentTime(mLastFrameTimestamp);
+}
+
+EyeModelFitter::EyeModelPtr EyeModelFitter::createModel( double timestamp ) const
+{
+    EyeModelPtr model( new EyeModel(mNextModelID, timestamp, mFocalLength, mCameraCenter) );
+    if( mBackgroundRefinement )
+        model->setRefinementExecutor(mRefinementExecutor);
+    model->setUseObservationTime(mUseObservationTime);
+    return model;
+}
+
+Clock::time_point EyeModelFitter::currentTime( double timestamp ) const
+{
+    return mUseObservationTime ? timestampToTimePoint(timestamp) : Clock::now();
+}
+
 void EyeModelFitter::reset()
 {
     mNextModelID = 1;
     mAlternativeModelsPtrs.clear();
-    mActiveModelPtr = EyeModelPtr( new EyeModel(mNextModelID , -1, mFocalLength, mCameraCenter ));
-    mLastTimeModelAdded =  Clock::now();
+    mActiveModelPtr = createModel(-1);
+    mLastTimeModelAdded = currentTime(mLastFrameTimestamp);
     mCurrentSphere = Sphere::Null;
     mCurrentInitialSphere = Sphere::Null;
-    //mLogger.setLogLevel( pupillabs::PyCppLogger::LogLevel::DEBUG);
-    //mLogger.info("Reset models");
-    //mLogger.error("Reset models");
+    mLogger.debug("Reset models");
 
 }
 
@@ -560,25 +615,12 @@ void EyeModelFitter::reset()
 
 // }
 
-Edges3D EyeModelFitter::unprojectEdges(const Edges2D& edges) const
+const Edges3D& EyeModelFitter::unprojectEdges(const Edges2D& edges) const
 {
-    Edges3D edgesOnSphere;
-    edgesOnSphere.reserve(edges.size());
-
-    for (auto& edge : edges) {
-        Vector3 point3D(edge.x, edge.y , mFocalLength);
-        Vector3 direction = point3D - mCameraCenter;
-
-        std::pair<Vector3, Vector3> unprojectedPoints;
-        // we use the eye properties of the current eye, when ever we call this
-        bool didIntersect = intersect(Line3(mCameraCenter,  direction.normalized()), mCurrentSphere, unprojectedPoints);
-
-        if( didIntersect)
-            edgesOnSphere.push_back(std::move(unprojectedPoints.first));
-
-    }
-
-    return edgesOnSphere;
+    // we use the eye properties of the current eye, when ever we call this
+    mEdgeUnprojection.unproject(edges, mCameraCenter, mFocalLength, mCurrentSphere);
+    mEdgeUnprojection.validPoints(mEdgesOnSphere);
+    return mEdgesOnSphere;
 
 }
 
@@ -696,7 +738,7 @@ void  EyeModelFitter::filterCircle2( const Circle& predictedCircle, const Edges2
         return;
 
 
-    Edges3D edgesOnSphere = unprojectEdges(rawEdges);
+    const Edges3D& edgesOnSphere = unprojectEdges(rawEdges);
 
     //Inorder to filter the edges depending on the distance of the predicted pupil center
     // imagine a sphere with center equal to the predicted pupil center (pupilcenters are always on the sphere )
@@ -736,48 +778,54 @@ void  EyeModelFitter::filterCircle2( const Circle& predictedCircle, const Edges2
     int maxEdgeCount = 0;
     Vector3 bestCircleCenter(0, 0, 0);
     double bestCircleRadius = 0.0;
-    double bestDistanceVariance = std::numeric_limits<double>::max();
-    Edges3D inliers;
     Edges3D finalInliers;
 
-    for (double i = minTheta; i <= maxTheta; i += stepSizeAngle) {
-        for (double j = minPsi; j <=  maxPsi; j += stepSizeAngle) {
-
-            // from here in cartesian again
-            // if we use cartesian we can just compare the distances from the pupil sphere center
-            // all this happens in world coordinates
-            const Vector3 newPupilCenter  = mCurrentSphere.center + math::sph2cart(mCurrentSphere.radius, i, j);
+    const auto pupilCenter = [&]( double theta, double psi ) -> Vector3 {
+        // from here in cartesian again
+        // if we use cartesian we can just compare the distances from the pupil sphere center
+        // all this happens in world coordinates
+        return mCurrentSphere.center + math::sph2cart(mCurrentSphere.radius, theta, psi);
+    };
 
-            const double bandWidth =  bandWidthPixel * newPupilCenter.z() / mFocalLength ;
-            const double bandWidthHalf = bandWidth / 2.0 ;
-            const double maxDistanceSquared  = std::pow(pupilSphereRadius + bandWidthHalf, 2) ;
-            const double minDistanceSquared  = std::pow(pupilSphereRadius - bandWidthHalf, 2) ;
+    // the band around the pupil circle with center newPupilCenter
+    const auto isInBand = [&]( const Vector3& newPupilCenter, const Vector3& e, double& distanceSquared ){
+        const double bandWidth =  bandWidthPixel * newPupilCenter.z() / mFocalLength ;
+        const double bandWidthHalf = bandWidth / 2.0 ;
+        const double maxDistanceSquared  = std::pow(pupilSphereRadius + bandWidthHalf, 2) ;
+        const double minDistanceSquared  = std::pow(pupilSphereRadius - bandWidthHalf, 2) ;
+        distanceSquared = (e - newPupilCenter).squaredNorm();
+        return distanceSquared < maxDistanceSquared && distanceSquared > minDistanceSquared;
+    };
 
-            if(mDebug)
-                inliers.clear();
+    const auto score = [&]( double theta, double psi, int& edgeCount, double& accRadius ){
+        const Vector3 newPupilCenter = pupilCenter(theta, psi);
+        //count all edges which fall into this current circle
+        for (const auto& e : filteredEdges) {
+            double distanceSquared;
+            if (isInBand(newPupilCenter, e, distanceSquared)) {
+                edgeCount++;
+                accRadius += std::sqrt(distanceSquared);
+            }
+        }
+    };
 
-            int  edgeCount = 0;
-            double accRadius = 0.0;
-            //count all edges which fall into this current circle
-            for (const auto& e : filteredEdges) {
+    const std::vector<double> thetas = searchAngles(minTheta, maxTheta, stepSizeAngle);
+    const std::vector<double> psis = searchAngles(minPsi, maxPsi, stepSizeAngle);
+    std::vector<int> edgeCounts;
+    std::vector<double> accRadii;
+    size_t best;
 
-                double distanceSquared = (e - newPupilCenter).squaredNorm();
-                if (distanceSquared < maxDistanceSquared && distanceSquared > minDistanceSquared) {
-                    edgeCount++;
-                    accRadius += std::sqrt(distanceSquared);
-                    if(mDebug)
-                        inliers.push_back(e);
-                }
-            }
+    if (searchGrid(thetas, psis, mThreadPool.get(), score, edgeCounts, accRadii, best)) {
+        bestCircleCenter = pupilCenter(thetas[best / psis.size()], psis[best % psis.size()]);
+        maxEdgeCount = edgeCounts[best];
+        bestCircleRadius = accRadii[best] / maxEdgeCount;
 
-            if (edgeCount > maxEdgeCount  ) {
-                bestCircleCenter = newPupilCenter;
-                bestCircleRadius = accRadius / edgeCount;
-                maxEdgeCount = edgeCount;
-                if(mDebug)
-                    finalInliers = std::move(inliers);
+        if (mDebug) {
+            for (const auto& e : filteredEdges) {
+                double distanceSquared;
+                if (isInBand(bestCircleCenter, e, distanceSquared))
+                    finalInliers.push_back(e);
             }
-
         }
     }
 
@@ -807,11 +855,11 @@ void  EyeModelFitter::filterCircle3( const Circle& predictedCircle, const Edges2
         return;
 
 
-    Edges3D edgesOnSphere = unprojectEdges(rawEdges);
+    const Edges3D& edgesOnSphere = unprojectEdges(rawEdges);
     Edges3D filteredEdges;
-    Edges3D finalInliers;
+    SphericalEdgeIndex edgeIndex;
     int maxEdgeCount;
-    auto searchCenter  = [this, &finalInliers, &edgesOnSphere, &maxEdgeCount, &predictedCircle, &filteredEdges ]( Vector3 searchCenter,   double positionVariance = 0.06, double searchStep = 0.005, int bandWidthPixel = 4 ) -> Circle {
+    auto searchCenter  = [this, &edgeIndex, &edgesOnSphere, &maxEdgeCount, &predictedCircle, &filteredEdges ]( Vector3 searchCenter,   double positionVariance = 0.06, double searchStep = 0.005, int bandWidthPixel = 4 ) -> Circle {
 
         //Inorder to filter the edges depending on the distance of the predicted pupil center
         // imagine a sphere with center equal to the predicted pupil center (pupilcenters are always on the sphere )
@@ -852,52 +900,44 @@ void  EyeModelFitter::filterCircle3( const Circle& predictedCircle, const Edges2
         // defined in pixel space and recalculated for 3D space further down
         //const int bandWidthPixel =  4 ;
 
+        // a band only looks at the edges in the bins of its cap, which is about pupilSphereRadius wide
+        const double binSize = std::max(stepSizeAngle, pupilSphereRadius / mCurrentSphere.radius / 4.0);
+        edgeIndex.build(mCurrentSphere.center, mCurrentSphere.radius, filteredEdges, binSize, predictedPupilCenter.y());
+
+        const auto pupilCenter = [&]( double theta, double psi ) -> Vector3 {
+            // from here in cartesian again
+            // if we use cartesian we can just compare the distances from the pupil sphere center
+            // all this happens in world coordinates
+            return mCurrentSphere.center + math::sph2cart(mCurrentSphere.radius, theta, psi);
+        };
+
+        const auto score = [&]( double theta, double psi, int& edgeCount, double& accRadius ){
+            const Vector3 newPupilCenter = pupilCenter(theta, psi);
+            const double bandWidth =  bandWidthPixel * newPupilCenter.z() / mFocalLength ;
+            const double bandWidthHalf = bandWidth / 2.0 ;
+            const double maxDistanceSquared  = std::pow(pupilSphereRadius + bandWidthHalf, 2) ;
+            const double minDistanceSquared  = std::pow(pupilSphereRadius - bandWidthHalf, 2) ;
+
+            //count all edges which fall into this current circle
+            edgeIndex.countBand(newPupilCenter, minDistanceSquared, maxDistanceSquared, edgeCount, accRadius);
+        };
+
+        const std::vector<double> thetas = searchAngles(minTheta, maxTheta, stepSizeAngle);
+        const std::vector<double> psis = searchAngles(minPsi, maxPsi, stepSizeAngle);
+        std::vector<int> edgeCounts;
+        std::vector<double> accRadii;
+        size_t best;
+
         maxEdgeCount = 0;
         Vector3 bestCircleCenter(0, 0, 0);
         double bestCircleRadius = 0.0;
-        double bestDistanceVariance = std::numeric_limits<double>::max();
-        Edges3D inliers;
-
-        for (double i = minTheta; i <= maxTheta; i += stepSizeAngle) {
-            for (double j = minPsi; j <=  maxPsi; j += stepSizeAngle) {
-
-                // from here in cartesian again
-                // if we use cartesian we can just compare the distances from the pupil sphere center
-                // all this happens in world coordinates
-                const Vector3 newPupilCenter  = mCurrentSphere.center + math::sph2cart(mCurrentSphere.radius, i, j);
-
-                const double bandWidth =  bandWidthPixel * newPupilCenter.z() / mFocalLength ;
-                const double bandWidthHalf = bandWidth / 2.0 ;
-                const double maxDistanceSquared  = std::pow(pupilSphereRadius + bandWidthHalf, 2) ;
-                const double minDistanceSquared  = std::pow(pupilSphereRadius - bandWidthHalf, 2) ;
-
-                if(mDebug)
-                    inliers.clear();
-
-                int  edgeCount = 0;
-                double accRadius = 0.0;
-                //count all edges which fall into this current circle
-                for (const auto& e : filteredEdges) {
-
-                    double distanceSquared = (e - newPupilCenter).squaredNorm();
-                    if (distanceSquared < maxDistanceSquared && distanceSquared > minDistanceSquared) {
-                        edgeCount++;
-                        accRadius += std::sqrt(distanceSquared);
-                        if(mDebug)
-                            inliers.push_back(e);
-                    }
-                }
-
-                if (edgeCount > maxEdgeCount  ) {
-                    bestCircleCenter = newPupilCenter;
-                    bestCircleRadius = accRadius / edgeCount;
-                    maxEdgeCount = edgeCount;
-                    if(mDebug)
-                        finalInliers = std::move(inliers);
-                }
 
-            }
+        if (searchGrid(thetas, psis, mThreadPool.get(), score, edgeCounts, accRadii, best)) {
+            bestCircleCenter = pupilCenter(thetas[best / psis.size()], psis[best % psis.size()]);
+            maxEdgeCount = edgeCounts[best];
+            bestCircleRadius = accRadii[best] / maxEdgeCount;
         }
+
         if (maxEdgeCount != 0){
             Circle circle;
             circle.center = bestCircleCenter;
@@ -940,8 +980,7 @@ void  EyeModelFitter::filterCircle3( const Circle& predictedCircle, const Edges2
 }
 
 
-Circle EyeModelFitter::predictPupilState( double deltaTime ){
-
+EyeModelFitter::PupilStateFilter::StateMatrix EyeModelFitter::pupilStateTransition( double deltaTime ){
 
     // correlates position and velocity
     // x,y are phi and theta
@@ -951,18 +990,23 @@ Circle EyeModelFitter::predictPupilState( double deltaTime ){
     // 0x + 0y + 0vx + 1vy + 0ax + deltaTime*ay = vy
     // 0x + 0y + 0vx + 0vy + 1ax + 0ay = ax
     // 0x + 0y + 0vx + 0vy + 0ax + 1ay = ay
-   mPupilState.transitionMatrix = (cv::Mat_<double>(7, 7) << 1, 0, deltaTime, 0, 0.5*deltaTime*deltaTime , 0, 0,
-                                                          0, 1, 0, deltaTime, 0 , 0.5*deltaTime*deltaTime, 0,
-                                                          0, 0, 1, 0, deltaTime, 0,0,
-                                                          0, 0, 0, 1, 0, deltaTime,0,
-                                                          0, 0, 0, 0, 1, 0,0,
-                                                          0, 0, 0, 0, 0, 1,0,
-                                                          0, 0, 0, 0, 0, 0,1);
-
-    cv::Mat pupilStatePrediction = mPupilState.predict();
-    double theta = pupilStatePrediction.at<double>(0);
-    double psi = pupilStatePrediction.at<double>(1);
-    double radius = pupilStatePrediction.at<double>(6);
+    PupilStateFilter::StateMatrix transitionMatrix;
+    transitionMatrix << 1, 0, deltaTime, 0, 0.5*deltaTime*deltaTime , 0, 0,
+                        0, 1, 0, deltaTime, 0 , 0.5*deltaTime*deltaTime, 0,
+                        0, 0, 1, 0, deltaTime, 0,0,
+                        0, 0, 0, 1, 0, deltaTime,0,
+                        0, 0, 0, 0, 1, 0,0,
+                        0, 0, 0, 0, 0, 1,0,
+                        0, 0, 0, 0, 0, 0,1;
+    return transitionMatrix;
+}
+
+Circle EyeModelFitter::predictPupilState( double deltaTime ){
+
+    const auto& pupilStatePrediction = mPupilState.predict( pupilStateTransition(deltaTime) );
+    double theta = pupilStatePrediction(0);
+    double psi = pupilStatePrediction(1);
+    double radius = pupilStatePrediction(6);
     return circleOnSphere( mCurrentSphere, theta, psi, radius );
 
 }
@@ -971,12 +1015,12 @@ Circle EyeModelFitter::predictPupilState( double deltaTime ){
 Circle EyeModelFitter::correctPupilState( const Circle& circle){
 
     Vector2 params = paramsOnSphere(mCurrentSphere, circle);
-    cv::Mat meausurement = (cv::Mat_<double>(3,1) << params[0], params[1], circle.radius );
-    auto estimated = mPupilState.correct( meausurement );
+    const PupilStateFilter::Measurement meausurement( params[0], params[1], circle.radius );
+    const auto& estimated = mPupilState.correct( meausurement );
 
-    double theta = estimated.at<double>(0);
-    double psi = estimated.at<double>(1);
-    double radius = estimated.at<double>(6);
+    double theta = estimated(0);
+    double psi = estimated(1);
+    double radius = estimated(6);
     auto estimatedCircle = circleOnSphere( mCurrentSphere , theta, psi, radius );
     return estimatedCircle;
 }
@@ -984,8 +1028,8 @@ Circle EyeModelFitter::correctPupilState( const Circle& circle){
 double EyeModelFitter::getPupilPositionErrorVar() const {
 
     // error variance
-    double thetaError = mPupilState.errorCovPost.at<double>(0,0);
-    double psiError = mPupilState.errorCovPost.at<double>(1,1);
+    double thetaError = mPupilState.errorCov(0,0);
+    double psiError = mPupilState.errorCov(1,1);
    // std::cout << "te: " << thetaError << std::endl;
    // std::cout << "pE: " << psiError << std::endl;
     // for now let's just use the average from both values
@@ -996,7 +1040,7 @@ double EyeModelFitter::getPupilPositionErrorVar() const {
 double EyeModelFitter::getPupilSizeErrorVar() const {
 
     // error variance
-    double sizeError = mPupilState.errorCovPost.at<double>(6,6);
+    double sizeError = mPupilState.errorCov(6,6);
     return sizeError;
 
 }
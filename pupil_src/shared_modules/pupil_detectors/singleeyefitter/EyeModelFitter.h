@@ -1,8 +1,6 @@
 #ifndef SingleEyeFitter_h__
 #define SingleEyeFitter_h__
 
-#include <opencv2/video/tracking.hpp> // Kalaman Filter
-
 #include <vector>
 #include <memory>
 #include <Eigen/Core>
@@ -13,8 +11,10 @@
 #include "geometry/Ellipse.h"
 #include "geometry/Sphere.h"
 #include "EyeModel.h"
+#include "EdgeUnprojection.h"
+#include "KalmanFilter.h"
 
-#include "logger/pycpplogger.h"
+#include "logger/ringlogger.h"
 
 
 namespace singleeyefitter {
@@ -25,6 +25,7 @@ namespace singleeyefitter {
 
             typedef singleeyefitter::Sphere<double> Sphere;
             typedef std::unique_ptr<EyeModel> EyeModelPtr;
+            typedef KalmanFilter<double, 7, 3> PupilStateFilter; // theta, psi, their velocities and accelerations, radius
 
             // Constructors
             EyeModelFitter(double focalLength, Vector3 cameraCenter = Vector3::Zero() );
@@ -34,6 +35,15 @@ namespace singleeyefitter {
             double getFocalLength(){ return mFocalLength; };
             void reset();
 
+            // the models refine themselves on pool, nullptr runs the refinements on workers of the fitter
+            void setThreadPool( std::shared_ptr<ThreadPool> pool );
+            // how many models may refine themselves at the same time
+            void setMaxRefinements( int count );
+            // false refines the models right away on the calling thread, e.g. offline where the fitters run in parallel
+            void setBackgroundRefinement( bool enabled );
+            // measure time with the timestamps of the observations instead of the clock, for offline fitting
+            void setUseObservationTime( bool use );
+
             // this is called with new observations from the 2D detector
             // it decides what happens ,since not all observations are added
             Detector3DResult updateAndDetect( std::shared_ptr<Detector2DResult>& observation,const Detector3DProperties& props, bool debug = false );
@@ -47,28 +57,41 @@ namespace singleeyefitter {
             bool mDebug;
 
             Clock::time_point mLastTimeModelAdded, mLastTimePerformancePenalty;
+            bool mUseObservationTime;
+            bool mBackgroundRefinement;
 
             int mNextModelID;
+            std::shared_ptr<ThreadPool> mThreadPool;
+            std::shared_ptr<RefinementExecutor> mRefinementExecutor; // outlives the models
             std::unique_ptr<EyeModel> mActiveModelPtr;
             std::list<EyeModelPtr> mAlternativeModelsPtrs;
 
             Sphere mCurrentSphere;
             Sphere mCurrentInitialSphere;
 
-            cv::KalmanFilter mPupilState;
+            PupilStateFilter mPupilState;
 
             double mLastFrameTimestamp; //needed to calculate framerate
             int mApproximatedFramerate;
             math::SMA<double> mAverageFramerate;
 
-            pupillabs::PyCppLogger mLogger;
+            pupillabs::RingLogger mLogger; // doesn't need the GIL, drained by the python side
+
+            // buffers of unprojectEdges, reused for every frame
+            mutable EdgeUnprojection mEdgeUnprojection;
+            mutable Edges3D mEdgesOnSphere;
 
             void checkModels( float sensitivity,double frame_timestamp);
+            // a new model with the id mNextModelID, which shares the executor and time of the fitter
+            EyeModelPtr createModel( double timestamp ) const;
+            Clock::time_point currentTime( double timestamp ) const;
 
             //Contours3D unprojectContours( const Contours_2D& contours) const;
-            Edges3D unprojectEdges(const Edges2D& edges) const;
+            // the edges on the current sphere, valid until the next call
+            const Edges3D& unprojectEdges(const Edges2D& edges) const;
 
             // whenever the 2D fit is bad we wanna call this and predict an new circle to use for findCircle
+            static PupilStateFilter::StateMatrix pupilStateTransition( double deltaTime );
             Circle predictPupilState( double deltaTime );
             Circle correctPupilState( const Circle& circle );
             double getPupilPositionErrorVar () const;
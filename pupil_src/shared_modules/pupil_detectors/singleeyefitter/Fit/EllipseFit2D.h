@@ -0,0 +1,132 @@
+#ifndef singleeyefitter_ellipsefit2d_h__
+#define singleeyefitter_ellipsefit2d_h__
+
+#include <cmath>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/LU>
+#include <Eigen/Eigenvalues>
+#include <Eigen/StdVector>
+#include <opencv2/core.hpp>
+
+#include "geometry/Conic.h"
+#include "geometry/Ellipse.h"
+#include "common/constants.h"
+
+
+namespace singleeyefitter {
+
+    // Direct least squares ellipse fit (Fitzgibbon et al. 1999), in the numerically stable form of Halir and Flusser 1998.
+    //
+    // The fit only depends on the scatter matrix D^T D of the design matrix with rows [x^2 xy y^2 x y 1].
+    // Scatter matrices are additive, so the fit of a set of contours only needs the sum of their scatter matrices.
+    // Points are normalized with a fixed origin and scale, all summed scatter matrices need to come from the same fitter.
+    class EllipseFitter2D {
+        public:
+            typedef Eigen::Matrix<double, 6, 6> Scatter;
+            typedef std::vector<Scatter, Eigen::aligned_allocator<Scatter>> Scatters;
+
+            EllipseFitter2D() : mOrigin(0.0, 0.0), mScale(1.0) {};
+
+            // origin and scale should map the points roughly to [-1,1], e.g. the center and the half size of the roi
+            EllipseFitter2D(const cv::Point2d& origin, double scale) : mOrigin(origin), mScale(scale > 0.0 ? scale : 1.0) {};
+
+            // adds the points to scatter
+            void addPoints(const std::vector<cv::Point>& points, Scatter& scatter) const
+            {
+                Eigen::Matrix<double, 6, 1> d;
+
+                for (const auto& p : points) {
+                    const double x = (p.x - mOrigin.x) / mScale;
+                    const double y = (p.y - mOrigin.y) / mScale;
+                    d << x * x, x * y, y * y, x, y, 1.0;
+                    scatter.noalias() += d * d.transpose();
+                }
+            }
+
+            Scatter scatter(const std::vector<cv::Point>& points) const
+            {
+                Scatter s = Scatter::Zero();
+                addPoints(points, s);
+                return s;
+            }
+
+            // fits an ellipse to the points of scatter
+            // the result follows the convention of cv::fitEllipse: size.height is the major axis
+            // returns false if there are less than 5 points or the points don't describe a proper ellipse
+            bool fit(const Scatter& scatter, cv::RotatedRect& ellipse) const
+            {
+                using std::isfinite;
+
+                // the last diagonal element counts the points
+                if (scatter(5, 5) < 5.0)
+                    return false;
+
+                const Eigen::Matrix3d S1 = scatter.topLeftCorner<3, 3>();
+                const Eigen::Matrix3d S2 = scatter.topRightCorner<3, 3>();
+                const Eigen::Matrix3d S3 = scatter.bottomRightCorner<3, 3>();
+                Eigen::Matrix3d S3_inverse;
+                bool invertible = false;
+                S3.computeInverseWithCheck(S3_inverse, invertible);
+
+                if (!invertible)
+                    return false;
+
+                // the linear part of the conic follows from the quadratic part
+                const Eigen::Matrix3d T = -S3_inverse * S2.transpose();
+                const Eigen::Matrix3d M = S1 + S2 * T;
+                // premultiply with the inverse of the constraint matrix for 4ac - b^2 = 1
+                Eigen::Matrix3d reduced;
+                reduced.row(0) = M.row(2) / 2.0;
+                reduced.row(1) = -M.row(1);
+                reduced.row(2) = M.row(0) / 2.0;
+
+                Eigen::EigenSolver<Eigen::Matrix3d> solver(reduced);
+
+                if (solver.info() != Eigen::Success)
+                    return false;
+
+                // exactly one eigenvector satisfies the ellipse constraint
+                int best = -1;
+                double best_constraint = 0.0;
+
+                for (int i = 0; i < 3; i++) {
+                    const Eigen::Vector3d v = solver.eigenvectors().col(i).real();
+                    const double constraint = 4.0 * v[0] * v[2] - v[1] * v[1];
+
+                    if (constraint > best_constraint) {
+                        best = i;
+                        best_constraint = constraint;
+                    }
+                }
+
+                if (best == -1)
+                    return false;
+
+                const Eigen::Vector3d a1 = solver.eigenvectors().col(best).real();
+                const Eigen::Vector3d a2 = T * a1;
+                const Conic<double> conic(a1[0], a1[1], a1[2], a2[0], a2[1], a2[2]);
+                const Ellipse2D<double> normalized(conic);
+
+                // imaginary ellipses have the same sign inside and outside
+                if (conic(normalized.center[0], normalized.center[1]) * (conic.A + conic.C) >= 0.0)
+                    return false;
+
+                if (!isfinite(normalized.center[0]) || !isfinite(normalized.center[1]) ||
+                        !isfinite(normalized.major_radius) || !(normalized.minor_radius > 0.0))
+                    return false;
+
+                ellipse.center = cv::Point2f(float(mOrigin.x + normalized.center[0] * mScale), float(mOrigin.y + normalized.center[1] * mScale));
+                ellipse.size = cv::Size2f(float(2.0 * normalized.minor_radius * mScale), float(2.0 * normalized.major_radius * mScale));
+                ellipse.angle = float(normalized.angle * 180.0 / constants::PI - 90.0);
+                return true;
+            }
+
+        private:
+            cv::Point2d mOrigin;
+            double mScale;
+    };
+
+} // namespace singleeyefitter
+
+#endif // singleeyefitter_ellipsefit2d_h__
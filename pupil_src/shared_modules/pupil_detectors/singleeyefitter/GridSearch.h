@@ -0,0 +1,59 @@
+#ifndef singleeyefitter_gridsearch_h__
+#define singleeyefitter_gridsearch_h__
+
+#include <vector>
+
+#include "ThreadPool.h"
+
+
+namespace singleeyefitter {
+
+    // Scores every cell of a theta/psi grid with score(theta, psi, edgeCount, accRadius) and sets best to the index
+    // (row major, theta is the row) of the first cell with the highest edge count. Returns false if no cell has an edge.
+    // The rows are scored in parallel if there is a pool. The cells are compared in the same order as a
+    // serial scan afterwards, so the result doesn't depend on the number of threads.
+    template<typename Score>
+    bool searchGrid( const std::vector<double>& thetas, const std::vector<double>& psis, ThreadPool* pool, const Score& score,
+                     std::vector<int>& edgeCounts, std::vector<double>& accRadii, size_t& best )
+    {
+        const size_t rows = thetas.size();
+        const size_t cols = psis.size();
+        edgeCounts.assign(rows * cols, 0);
+        accRadii.assign(rows * cols, 0.0);
+
+        auto scoreRow = [&]( size_t row ){
+            for( size_t col = 0; col < cols; col++ )
+                score(thetas[row], psis[col], edgeCounts[row * cols + col], accRadii[row * cols + col]);
+        };
+
+        if( pool )
+            pool->parallelFor(0, int(rows), scoreRow);
+        else
+            for( size_t row = 0; row < rows; row++ ) scoreRow(row);
+
+        bool found = false;
+        int maxEdgeCount = 0;
+
+        for( size_t i = 0; i < edgeCounts.size(); i++ ){
+            if( edgeCounts[i] > maxEdgeCount ){
+                maxEdgeCount = edgeCounts[i];
+                best = i;
+                found = true;
+            }
+        }
+
+        return found;
+    }
+
+    // the angles of a search from min to max, accumulated like the loops of the serial search
+    inline std::vector<double> searchAngles( double min, double max, double step )
+    {
+        std::vector<double> angles;
+        for( double angle = min; angle <= max; angle += step )
+            angles.push_back(angle);
+        return angles;
+    }
+
+} // namespace singleeyefitter
+
+#endif // singleeyefitter_gridsearch_h__
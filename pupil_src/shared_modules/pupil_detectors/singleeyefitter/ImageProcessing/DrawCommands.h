@@ -0,0 +1,203 @@
+#ifndef singleeyefitter_drawcommands_h__
+#define singleeyefitter_drawcommands_h__
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "cvx.h"
+
+namespace singleeyefitter {
+
+    // Visualization of the 2D detection on the color image (CV_8UC3).
+    //
+    // Without a target the primitives are recorded and drawn later by render, e.g. only when the image is displayed.
+    // With a target they are drawn right away. The recorded commands are reused from frame to frame,
+    // so recording doesn't allocate once their buffers have grown.
+    class DrawCommands {
+        public:
+
+            DrawCommands() : mTarget(nullptr), mSize(0) {};
+
+            // draw into target right away, nullptr to record
+            void setTarget(cv::Mat* target) { mTarget = target; }
+            void clear() { mSize = 0; }
+            bool empty() const { return mSize == 0; }
+            size_t size() const { return mSize; }
+            // drops the commands recorded after the first size ones, drawn commands can't be taken back
+            void truncate(size_t size) { mSize = std::min(mSize, size); }
+
+            void line(cv::Point a, cv::Point b, const cv::Scalar& color)
+            {
+                Command& c = next(Type::Line);
+                c.points.assign({a, b});
+                c.color = color;
+                flush();
+            }
+
+            void circle(cv::Point center, int radius, const cv::Scalar& color)
+            {
+                Command& c = next(Type::Circle);
+                c.points.assign({center});
+                c.radius = radius;
+                c.color = color;
+                flush();
+            }
+
+            void text(const std::string& text, cv::Point origin, double scale, const cv::Scalar& color)
+            {
+                Command& c = next(Type::Text);
+                c.text = text;
+                c.points.assign({origin});
+                c.scale = scale;
+                c.color = color;
+                flush();
+            }
+
+            // cvx::draw_dotted_rect of rect in the sub image area
+            void dottedRect(const cv::Rect& area, const cv::Rect& rect, const cv::Scalar& color)
+            {
+                Command& c = next(Type::DottedRect);
+                c.rect = area;
+                c.rect2 = rect;
+                c.color = color;
+                flush();
+            }
+
+            // sets one channel of the pixels at points + offset to 255
+            void points(const std::vector<cv::Point>& points, cv::Point offset, int channel)
+            {
+                if (mTarget) {
+                    drawPoints(*mTarget, points, offset, channel);
+                    return;
+                }
+
+                Command& c = next(Type::Points);
+                c.points.assign(points.begin(), points.end());
+                c.origin = offset;
+                c.channel = channel;
+            }
+
+            // edges into green, the pupil mask into blue, without the glints, in the roi
+            void maskOverlay(const cv::Rect& roi, const cv::Mat& edges, const cv::Mat& pupil_mask, const cv::Mat& spectral_mask)
+            {
+                if (mTarget) {
+                    drawMaskOverlay(*mTarget, roi, edges, pupil_mask, spectral_mask);
+                    return;
+                }
+
+                // the masks are views into the workspace of the detector, which the next frame overwrites
+                Command& c = next(Type::MaskOverlay);
+                c.rect = roi;
+                edges.copyTo(c.masks[0]);
+                pupil_mask.copyTo(c.masks[1]);
+                spectral_mask.copyTo(c.masks[2]);
+            }
+
+            void render(cv::Mat& image) const
+            {
+                for (size_t i = 0; i < mSize; i++) {
+                    draw(mCommands[i], image);
+                }
+            }
+
+        private:
+
+            enum struct Type {Line, Circle, Text, DottedRect, Points, MaskOverlay};
+
+            struct Command {
+                Type type;
+                std::vector<cv::Point> points;
+                cv::Point origin;
+                cv::Rect rect;
+                cv::Rect rect2;
+                cv::Scalar color;
+                int radius = 0;
+                int channel = 0;
+                double scale = 0.0;
+                std::string text;
+                cv::Mat masks[3];
+            };
+
+            cv::Mat* mTarget;
+            std::vector<Command> mCommands;
+            size_t mSize;
+
+            Command& next(Type type)
+            {
+                if (mSize == mCommands.size()) mCommands.emplace_back();
+
+                Command& c = mCommands[mSize++];
+                c.type = type;
+                return c;
+            }
+
+            // draws the last command right away if there is a target
+            void flush()
+            {
+                if (!mTarget) return;
+
+                draw(mCommands[--mSize], *mTarget);
+            }
+
+            static void draw(const Command& c, cv::Mat& image)
+            {
+                switch (c.type) {
+                    case Type::Line:
+                        cv::line(image, c.points[0], c.points[1], c.color);
+                        break;
+
+                    case Type::Circle:
+                        cv::circle(image, c.points[0], c.radius, c.color);
+                        break;
+
+                    case Type::Text:
+                        cv::putText(image, c.text, c.points[0], cv::FONT_HERSHEY_SIMPLEX, c.scale, c.color);
+                        break;
+
+                    case Type::DottedRect: {
+                        cv::Mat overlay(image, c.rect);
+                        cvx::draw_dotted_rect(overlay, c.rect2, c.color);
+                        break;
+                    }
+
+                    case Type::Points:
+                        drawPoints(image, c.points, c.origin, c.channel);
+                        break;
+
+                    case Type::MaskOverlay:
+                        drawMaskOverlay(image, c.rect, c.masks[0], c.masks[1], c.masks[2]);
+                        break;
+                }
+            }
+
+            static void drawPoints(cv::Mat& image, const std::vector<cv::Point>& points, cv::Point offset, int channel)
+            {
+                for (const auto& p : points) {
+                    image.at<cv::Vec3b>(p + offset)[channel] = 255;
+                }
+            }
+
+            static void drawMaskOverlay(cv::Mat& image, const cv::Rect& roi, const cv::Mat& edges, const cv::Mat& pupil_mask, const cv::Mat& spectral_mask)
+            {
+                // per pixel: green = max(green, edges), blue = min(max(blue, pupil_mask), spectral_mask)
+                for (int y = 0; y < roi.height; y++) {
+                    cv::Vec3b* out = image.ptr<cv::Vec3b>(roi.y + y) + roi.x;
+                    const uchar* e = edges.ptr<uchar>(y);
+                    const uchar* b = pupil_mask.ptr<uchar>(y);
+                    const uchar* s = spectral_mask.ptr<uchar>(y);
+
+                    for (int x = 0; x < roi.width; x++) {
+                        out[x][1] = std::max(out[x][1], e[x]);
+                        out[x][0] = std::min(std::max(out[x][0], b[x]), s[x]);
+                    }
+                }
+            }
+    };
+
+} // namespace singleeyefitter
+
+#endif // singleeyefitter_drawcommands_h__
@@ -0,0 +1,208 @@
+#ifndef singleeyefitter_edgemaskfilter_h__
+#define singleeyefitter_edgemaskfilter_h__
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace singleeyefitter {
+
+    // Removes the edges which are not dark enough or close to a glint, in one pass over the image.
+    //
+    // Gives the same edges, byte for byte, as
+    //     inRange(image, 0, dark_threshold, dark);          dilate(dark, dark, kernel, {-1, -1}, 2);
+    //     inRange(image, 0, spectral_threshold, spectral);  erode(spectral, spectral, kernel);
+    //     min(edges, spectral, edges);                      min(edges, dark, edges);
+    // with the default borders of dilate and erode, which ignore the pixels outside of the image.
+    //
+    // Instead of full size masks, only the last kernel height rows of each step are kept in ring buffers.
+    // Every row of the kernel needs to be one run of set pixels, like the rows of MORPH_ELLIPSE and MORPH_RECT,
+    // so the morphology is a maximum (or minimum) of horizontal run filters of the neighbouring rows.
+    class EdgeMaskFilter {
+        public:
+
+            EdgeMaskFilter() : mRows(0), mAnchor(0), mCols(0) {};
+            explicit EdgeMaskFilter(const cv::Mat& kernel) : mCols(0) { setKernel(kernel); }
+
+            void setKernel(const cv::Mat& kernel)
+            {
+                CV_Assert(kernel.type() == CV_8UC1 && !kernel.empty());
+                mRows = kernel.rows;
+                mAnchor = kernel.rows / 2;
+                mRowRun.assign(mRows, -1);
+                mRuns.clear();
+
+                for (int i = 0; i < mRows; i++) {
+                    const uchar* k = kernel.ptr<uchar>(i);
+                    int begin = -1, end = -1;
+
+                    for (int j = 0; j < kernel.cols; j++) {
+                        if (!k[j]) continue;
+
+                        CV_Assert(end == -1 || end == j - 1); // one run per row
+                        if (begin == -1) begin = j;
+                        end = j;
+                    }
+
+                    if (begin == -1) continue;
+
+                    // offsets relative to the anchor, rows with the same run share their filtered rows
+                    const Run run = {begin - kernel.cols / 2, end - kernel.cols / 2};
+                    auto it = std::find_if(mRuns.begin(), mRuns.end(), [&](const Run & r) { return r.begin == run.begin && r.end == run.end; });
+                    mRowRun[i] = int(it - mRuns.begin());
+
+                    if (it == mRuns.end()) mRuns.push_back(run);
+                }
+
+                mCols = 0;
+            }
+
+            // masks edges in place, image and edges are CV_8UC1 of the same size
+            // if dark_mask or spectral_mask are given, they receive the masks (CV_8UC1, 0 or 255) for visualisation
+            void apply(const cv::Mat& image, cv::Mat& edges, int dark_threshold, int spectral_threshold,
+                       cv::Mat* dark_mask = nullptr, cv::Mat* spectral_mask = nullptr)
+            {
+                CV_Assert(image.type() == CV_8UC1 && edges.type() == CV_8UC1 && image.size() == edges.size() && mRows > 0);
+                const int rows = image.rows;
+                const int below = mRows - 1 - mAnchor;
+                allocate(image.cols);
+
+                if (dark_mask) dark_mask->create(image.size(), CV_8UC1);
+                if (spectral_mask) spectral_mask->create(image.size(), CV_8UC1);
+
+                // the first dilation lags below rows behind the thresholds, the second one 2 * below rows
+                for (int step = 0; step < rows + 2 * below; step++) {
+                    if (step < rows) {
+                        const uchar* in = image.ptr<uchar>(step);
+
+                        for (int x = 0; x < mCols; x++) {
+                            mRow[x] = in[x] <= dark_threshold;
+                        }
+
+                        runFilter(mRow.data(), slot(mDark, step), true);
+
+                        for (int x = 0; x < mCols; x++) {
+                            mRow[x] = in[x] <= spectral_threshold;
+                        }
+
+                        runFilter(mRow.data(), slot(mSpectral, step), false);
+                    }
+
+                    const int y1 = step - below;
+
+                    if (y1 >= 0 && y1 < rows) {
+                        // first dilation of the dark mask, filtered again for the second one
+                        combine(mDark, y1, rows, true, mRow.data());
+                        runFilter(mRow.data(), slot(mDilated, y1), true);
+
+                        // the glint mask only needs one erosion, it is applied right away
+                        combine(mSpectral, y1, rows, false, mRow.data());
+                        applyRow(mRow.data(), edges.ptr<uchar>(y1), spectral_mask ? spectral_mask->ptr<uchar>(y1) : nullptr);
+                    }
+
+                    const int y2 = step - 2 * below;
+
+                    if (y2 >= 0 && y2 < rows) {
+                        combine(mDilated, y2, rows, true, mRow.data());
+                        applyRow(mRow.data(), edges.ptr<uchar>(y2), dark_mask ? dark_mask->ptr<uchar>(y2) : nullptr);
+                    }
+                }
+            }
+
+        private:
+
+            struct Run {
+                int begin, end; // column offsets relative to the anchor, inclusive
+            };
+
+            int mRows;
+            int mAnchor;
+            int mCols;
+            std::vector<int> mRowRun; // index into mRuns for every kernel row, -1 for empty rows
+            std::vector<Run> mRuns;
+
+            // ring buffers of mRows rows, each row holds every run filter of it (0 or 1 per pixel)
+            std::vector<uchar> mDark;
+            std::vector<uchar> mDilated;
+            std::vector<uchar> mSpectral;
+            std::vector<uchar> mRow;
+            std::vector<int> mCounts;
+
+            void allocate(int cols)
+            {
+                if (cols == mCols) return;
+
+                mCols = cols;
+                const size_t ring = size_t(mRows) * mRuns.size() * cols;
+                mDark.resize(ring);
+                mDilated.resize(ring);
+                mSpectral.resize(ring);
+                mRow.resize(cols);
+                mCounts.resize(cols + 1);
+            }
+
+            uchar* slot(std::vector<uchar>& ring, int y)
+            {
+                return ring.data() + size_t(y % mRows) * mRuns.size() * mCols;
+            }
+
+            // filters row with every run, pixels outside of the row are ignored
+            // dilate: any pixel of the run is set, erode: all pixels of the run inside the row are set
+            void runFilter(const uchar* row, uchar* out, bool dilate)
+            {
+                int* counts = mCounts.data();
+                counts[0] = 0;
+
+                for (int x = 0; x < mCols; x++) {
+                    counts[x + 1] = counts[x] + row[x];
+                }
+
+                for (size_t r = 0; r < mRuns.size(); r++) {
+                    const Run& run = mRuns[r];
+                    uchar* o = out + r * mCols;
+
+                    for (int x = 0; x < mCols; x++) {
+                        const int begin = std::max(0, x + run.begin);
+                        const int end = std::min(mCols, x + run.end + 1);
+                        const int count = end > begin ? counts[end] - counts[begin] : 0;
+                        o[x] = dilate ? count > 0 : count == std::max(0, end - begin);
+                    }
+                }
+            }
+
+            // combines the run filtered rows around y, rows outside of the image are ignored
+            void combine(std::vector<uchar>& ring, int y, int rows, bool dilate, uchar* out)
+            {
+                std::fill(out, out + mCols, uchar(dilate ? 0 : 1));
+
+                for (int i = 0; i < mRows; i++) {
+                    const int source = y + i - mAnchor;
+
+                    if (mRowRun[i] < 0 || source < 0 || source >= rows) continue;
+
+                    const uchar* in = slot(ring, source) + size_t(mRowRun[i]) * mCols;
+
+                    if (dilate) {
+                        for (int x = 0; x < mCols; x++) out[x] |= in[x];
+                    } else {
+                        for (int x = 0; x < mCols; x++) out[x] &= in[x];
+                    }
+                }
+            }
+
+            void applyRow(const uchar* mask, uchar* edges, uchar* mask_out)
+            {
+                for (int x = 0; x < mCols; x++) {
+                    if (!mask[x]) edges[x] = 0;
+                }
+
+                if (mask_out) {
+                    for (int x = 0; x < mCols; x++) mask_out[x] = mask[x] ? 255 : 0;
+                }
+            }
+    };
+
+} // namespace singleeyefitter
+
+#endif // singleeyefitter_edgemaskfilter_h__
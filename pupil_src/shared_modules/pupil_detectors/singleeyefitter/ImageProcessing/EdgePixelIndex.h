@@ -0,0 +1,156 @@
+#ifndef singleeyefitter_edgepixelindex_h__
+#define singleeyefitter_edgepixelindex_h__
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace singleeyefitter {
+
+    // Row bucket index over edge pixels, used to find the edge pixels supporting polylines
+    // without drawing the polylines into a mask of the whole image.
+    //
+    // The edge pixels need to be sorted row major, like the output of cv::findNonZero.
+    // A pixel supports the polylines if it is set when they are drawn with cv::polylines and a thickness of 2.
+    // The polylines are drawn into a mask of their bounding box only, and just the edge pixels within the box are
+    // tested, which gives the same pixels as masking the edge image with a support mask of the image size.
+    class EdgePixelIndex {
+        public:
+
+            EdgePixelIndex() : mEdges(nullptr) {};
+
+            void build(const std::vector<cv::Point>& edges, const cv::Size& size)
+            {
+                mEdges = &edges;
+                mSize = size;
+                mRowStart.assign(size.height + 1, 0);
+
+                // count pixels per row, then turn the counts into start offsets
+                for (const auto& p : edges) {
+                    mRowStart[p.y + 1]++;
+                }
+
+                for (int y = 0; y < size.height; y++) {
+                    mRowStart[y + 1] += mRowStart[y];
+                }
+
+                mExcluded.assign(edges.size(), false);
+            }
+
+            // the pixel at index in the edges vector won't be reported by any query
+            void exclude(size_t index)
+            {
+                mExcluded.at(index) = true;
+            }
+
+            // support pixels of a single polyline, in row major order
+            void query(const std::vector<cv::Point>& polyline, std::vector<cv::Point>& support)
+            {
+                beginQuery();
+                addPolyline(polyline);
+                endQuery(support);
+            }
+
+            // support pixels of several polylines, every pixel is reported only once
+            void query(const std::vector<std::vector<cv::Point>>& polylines, std::vector<cv::Point>& support)
+            {
+                beginQuery();
+
+                for (const auto& polyline : polylines) {
+                    addPolyline(polyline);
+                }
+
+                endQuery(support);
+            }
+
+            // support pixels of the polylines at indices
+            void query(const std::vector<std::vector<cv::Point>>& polylines, const std::vector<int>& indices, std::vector<cv::Point>& support)
+            {
+                beginQuery();
+
+                for (int index : indices) {
+                    addPolyline(polylines[index]);
+                }
+
+                endQuery(support);
+            }
+
+        private:
+
+            const std::vector<cv::Point>* mEdges;
+            cv::Size mSize;
+            std::vector<int> mRowStart;
+            std::vector<bool> mExcluded;
+
+            // polylines of the current query and their bounding box
+            std::vector<std::vector<cv::Point>> mPolylines;
+            size_t mPolylineCount;
+            cv::Rect mBounds;
+            cv::Mat mMask;
+
+            // a line of thickness 2 is drawn as a band of half width 1 with round caps of radius 1
+            static const int sMargin = 2;
+
+            void beginQuery()
+            {
+                mPolylineCount = 0;
+                mBounds = cv::Rect();
+            }
+
+            void addPolyline(const std::vector<cv::Point>& polyline)
+            {
+                if (polyline.empty()) return;
+
+                if (mPolylines.size() <= mPolylineCount)
+                    mPolylines.resize(mPolylineCount + 1);
+
+                mPolylines[mPolylineCount++].assign(polyline.begin(), polyline.end());
+                const cv::Rect bounds = cv::boundingRect(polyline);
+                mBounds = mBounds.area() > 0 ? (mBounds | bounds) : bounds;
+            }
+
+            void endQuery(std::vector<cv::Point>& support)
+            {
+                support.clear();
+
+                if (mPolylineCount == 0) return;
+
+                // the drawn pixels of the box within the image are the pixels of a mask of the image size
+                const cv::Rect box = cv::Rect(mBounds.x - sMargin, mBounds.y - sMargin,
+                                              mBounds.width + 2 * sMargin, mBounds.height + 2 * sMargin) & cv::Rect(0, 0, mSize.width, mSize.height);
+
+                if (box.area() == 0) return;
+
+                for (size_t i = 0; i < mPolylineCount; i++) {
+                    for (auto& p : mPolylines[i]) {
+                        p -= box.tl();
+                    }
+                }
+
+                mMask.create(box.height, box.width, CV_8UC1);
+                mMask.setTo(0);
+                // the buffer holds polylines of earlier queries after the current ones, so they are drawn one by one
+                for (size_t i = 0; i < mPolylineCount; i++) {
+                    cv::polylines(mMask, mPolylines[i], false, 255, 2);
+                }
+
+                // rows are visited top down and each row left to right, which is the order of findNonZero
+                for (int y = box.y; y < box.br().y; y++) {
+                    const uchar* mask_row = mMask.ptr<uchar>(y - box.y);
+                    const auto row_begin = mEdges->begin() + mRowStart[y];
+                    const auto row_end = mEdges->begin() + mRowStart[y + 1];
+                    auto it = std::lower_bound(row_begin, row_end, box.x, [](const cv::Point & p, int x) { return p.x < x; });
+
+                    for (; it != row_end && it->x < box.br().x; it++) {
+                        if (mask_row[it->x - box.x] && !mExcluded[it - mEdges->begin()])
+                            support.push_back(*it);
+                    }
+                }
+            }
+    };
+
+} // namespace singleeyefitter
+
+#endif // singleeyefitter_edgepixelindex_h__
@@ -0,0 +1,76 @@
+#ifndef singleeyefitter_kalmanfilter_h__
+#define singleeyefitter_kalmanfilter_h__
+
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+
+namespace singleeyefitter {
+
+    // Linear Kalman filter with fixed sizes, so predicting and correcting works on the stack.
+    //
+    // Works like cv::KalmanFilter without control input: state and errorCov are the estimate after the last
+    // predict or correct, and correct uses the state of the last predict.
+    template<typename Scalar, int States, int Measurements>
+    class KalmanFilter {
+        public:
+
+            EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+            typedef Eigen::Matrix<Scalar, States, 1> State;
+            typedef Eigen::Matrix<Scalar, Measurements, 1> Measurement;
+            typedef Eigen::Matrix<Scalar, States, States> StateMatrix;
+            typedef Eigen::Matrix<Scalar, Measurements, States> MeasurementMatrix;
+            typedef Eigen::Matrix<Scalar, Measurements, Measurements> MeasurementNoise;
+
+            KalmanFilter() :
+                state(State::Zero()),
+                errorCov(StateMatrix::Identity()),
+                processNoiseCov(StateMatrix::Identity()),
+                measurementMatrix(MeasurementMatrix::Zero()),
+                measurementNoiseCov(MeasurementNoise::Identity()) {};
+
+            const State& predict(const StateMatrix& transitionMatrix)
+            {
+                state = transitionMatrix * state;
+                errorCov = transitionMatrix * errorCov * transitionMatrix.transpose() + processNoiseCov;
+                return state;
+            }
+
+            const State& correct(const Measurement& measurement)
+            {
+                // K = P H^T (H P H^T + R)^-1, the covariance is symmetric positive definite
+                const Eigen::Matrix<Scalar, States, Measurements> PHt = errorCov * measurementMatrix.transpose();
+                const MeasurementNoise S = measurementMatrix * PHt + measurementNoiseCov;
+                const Eigen::Matrix<Scalar, States, Measurements> gain = S.ldlt().solve(PHt.transpose()).transpose();
+
+                state += gain * (measurement - measurementMatrix * state);
+                errorCov -= gain * PHt.transpose();
+                return state;
+            }
+
+            // The states of steps predictions from the current state, each one transitionMatrix later than the one
+            // before, without changing the filter. Column i is the state after i + 1 steps.
+            template<int Steps>
+            Eigen::Matrix<Scalar, States, Steps> predictAhead(const StateMatrix& transitionMatrix) const
+            {
+                Eigen::Matrix<Scalar, States, Steps> states;
+                State next = state;
+
+                for (int i = 0; i < Steps; i++) {
+                    next = transitionMatrix * next;
+                    states.col(i) = next;
+                }
+
+                return states;
+            }
+
+            State state;
+            StateMatrix errorCov;
+            StateMatrix processNoiseCov;
+            MeasurementMatrix measurementMatrix;
+            MeasurementNoise measurementNoiseCov;
+    };
+
+} // namespace singleeyefitter
+
+#endif // singleeyefitter_kalmanfilter_h__
@@ -0,0 +1,106 @@
+#include "OfflineEyeModelFitter.h"
+#include "EyeModelFitter.h"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+namespace singleeyefitter {
+
+namespace {
+
+    class FitSegments : public cv::ParallelLoopBody {
+        public:
+            FitSegments( const std::function<void(int)>& fitSegment ) : mFitSegment(fitSegment) {};
+
+            void operator()( const cv::Range& range ) const override
+            {
+                for( int segment = range.start; segment < range.end; segment++ ){
+                    mFitSegment(segment);
+                }
+            }
+
+        private:
+            const std::function<void(int)>& mFitSegment;
+    };
+
+} // namespace
+
+
+OfflineEyeModelFitter::OfflineEyeModelFitter(double focalLength, Vector3 cameraCenter) :
+    mFocalLength(focalLength),
+    mCameraCenter(std::move(cameraCenter))
+{
+}
+
+void OfflineEyeModelFitter::fit( const std::vector<Detector2DResult>& observations, const Detector3DProperties& props,
+                                 const OfflineFitterOptions& options, std::vector<Detector3DResult>& results )
+{
+    results.clear();
+    results.resize(observations.size());
+
+    if( observations.empty() )
+        return;
+
+    int segmentLength = options.segment_length;
+
+    if( segmentLength <= 0 ){
+        const int threads = std::max(1, cv::getNumThreads());
+        segmentLength = int( (observations.size() + threads - 1) / threads );
+    }
+
+    const int segments = int( (observations.size() + segmentLength - 1) / segmentLength );
+    const size_t warmupLength = size_t(std::max(0, options.warmup_length));
+
+    // the observations kept from the previous call come first, they only warm up the first segment
+    std::vector<const Detector2DResult*> sequence;
+    sequence.reserve(mWarmup.size() + observations.size());
+    for( const auto& observation : mWarmup ) sequence.push_back(&observation);
+    for( const auto& observation : observations ) sequence.push_back(&observation);
+    const size_t first = mWarmup.size();
+
+    const std::function<void(int)> fitSegment = [&](int segment){
+        const size_t begin = first + size_t(segment) * segmentLength;
+        const size_t end = std::min(sequence.size(), begin + segmentLength);
+        const size_t warmup = begin - std::min(begin, warmupLength);
+        this->fitSegment(sequence, props, warmup, begin, end, first, results);
+    };
+
+    cv::parallel_for_(cv::Range(0, segments), FitSegments(fitSegment));
+
+    // every segment numbered its models from 1, give them unique ids in recording order
+    // and continue the model of the previous segment if the spheres agree at the boundary
+    for( int segment = 0; segment < segments; segment++ ){
+        const size_t begin = size_t(segment) * segmentLength;
+        const size_t end = std::min(observations.size(), begin + segmentLength);
+        mModelIDs.join(results, begin, end, options.merge_distance);
+    }
+
+    // the next call continues after the last observation
+    std::vector<Detector2DResult> warmup;
+    warmup.reserve(std::min(warmupLength, sequence.size()));
+    for( size_t i = sequence.size() - std::min(warmupLength, sequence.size()); i < sequence.size(); i++ )
+        warmup.push_back(*sequence[i]);
+    mWarmup.swap(warmup);
+}
+
+void OfflineEyeModelFitter::fitSegment( const std::vector<const Detector2DResult*>& observations, const Detector3DProperties& props,
+                                        size_t warmup, size_t begin, size_t end, size_t first, std::vector<Detector3DResult>& results ) const
+{
+    EyeModelFitter fitter(mFocalLength, mCameraCenter);
+    fitter.setUseObservationTime(true); // the frames are fitted much faster than they were recorded
+    fitter.setBackgroundRefinement(false); // the segments already use every core
+
+    for( size_t i = warmup; i < end; i++ ){
+        // updateAndDetect changes the observation, and the warmup frames belong to another segment
+        auto observation = std::make_shared<Detector2DResult>(*observations[i]);
+        Detector3DResult result = fitter.updateAndDetect(observation, props);
+
+        if( i >= begin )
+            results[i - first] = std::move(result);
+    }
+}
+
+} // singleeyefitter
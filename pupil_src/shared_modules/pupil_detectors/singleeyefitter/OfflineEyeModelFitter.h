@@ -0,0 +1,55 @@
+#ifndef singleeyefitter_offlineeyemodelfitter_h__
+#define singleeyefitter_offlineeyemodelfitter_h__
+
+#include <vector>
+
+#include "common/types.h"
+#include "SegmentModelIDs.h"
+
+
+namespace singleeyefitter {
+
+    struct OfflineFitterOptions {
+        int segment_length = 0; // frames per segment, 0 spreads the frames evenly over the threads
+        int warmup_length = 600; // frames before a segment which are fitted first, their results are dropped
+        double merge_distance = 1.0; // spheres closer than this at a segment boundary keep the model id
+    };
+
+    // Offline 3D detection of a whole recording.
+    //
+    // The recording is split into segments of consecutive frames, each one is fitted by its own EyeModelFitter in parallel.
+    // Before a segment the fitter sees the last warmup_length frames of the previous one, so its eye model
+    // is already built up when the segment starts. A final pass over the segments in order makes the model ids unique
+    // and gives the model of a segment the id of the previous one if their spheres agree at the boundary.
+    // The fitters measure time with the observation timestamps, so the model checks don't depend on how fast the
+    // frames are fitted.
+    //
+    // A recording can be fitted in chunks by consecutive calls of fit: the first segment of a call is warmed up on the
+    // last observations of the previous call, and its models continue the ids of the previous call.
+    class OfflineEyeModelFitter {
+        public:
+
+            OfflineEyeModelFitter(double focalLength, Vector3 cameraCenter = Vector3::Zero() );
+
+            // observations are sorted by timestamp, like the frames of a recording, and follow the ones of the previous call
+            // results gets one result per observation
+            void fit( const std::vector<Detector2DResult>& observations, const Detector3DProperties& props,
+                      const OfflineFitterOptions& options, std::vector<Detector3DResult>& results );
+
+        private:
+
+            const double mFocalLength;
+            const Vector3 mCameraCenter;
+
+            // state carried over to the next call
+            std::vector<Detector2DResult> mWarmup; // the last warmup_length observations
+            SegmentModelIDs mModelIDs;
+
+            // fits observations[warmup, end), results[i - first] gets the result of observations[i] from begin on
+            void fitSegment( const std::vector<const Detector2DResult*>& observations, const Detector3DProperties& props,
+                             size_t warmup, size_t begin, size_t end, size_t first, std::vector<Detector3DResult>& results ) const;
+    };
+
+}
+
+#endif // singleeyefitter_offlineeyemodelfitter_h__
@@ -0,0 +1,146 @@
+#include "RefinementExecutor.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace singleeyefitter {
+
+RefinementExecutor::RefinementExecutor( int maxConcurrency ) : mRunners(0), mMaxConcurrency(std::max(1, maxConcurrency)), mPoolGeneration(0)
+{
+}
+
+RefinementExecutor::~RefinementExecutor()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mPending.clear();
+    mJobDone.wait(lock, [this](){ return mRunners == 0; });
+}
+
+void RefinementExecutor::setThreadPool( std::shared_ptr<ThreadPool> pool )
+{
+    // the previous pool may be released here, its destructor waits for the runners, which need the lock
+    std::shared_ptr<ThreadPool> previous;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        previous = std::move(mThreadPool);
+        mThreadPool = std::move(pool);
+        mPoolGeneration++; // the runners on the previous pool stop after their current job
+        startRunners(lock);
+    }
+}
+
+void RefinementExecutor::setMaxConcurrency( int maxConcurrency )
+{
+    std::shared_ptr<ThreadPool> previous;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mMaxConcurrency = std::max(1, maxConcurrency);
+
+        // the own pool has one worker per runner, a larger maximum needs a larger pool
+        if( mOwnThreadPool && mOwnThreadPool->size() < mMaxConcurrency ){
+            previous = std::move(mOwnThreadPool);
+            mPoolGeneration++;
+        }
+
+        startRunners(lock); // surplus runners stop after their current job
+    }
+}
+
+int RefinementExecutor::getMaxConcurrency() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mMaxConcurrency;
+}
+
+void RefinementExecutor::submit( const void* owner, std::function<void()> job )
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    auto pending = std::find_if(mPending.begin(), mPending.end(), [owner]( const Job& j ){ return j.owner == owner; });
+    if( pending != mPending.end() )
+        pending->work = std::move(job);
+    else
+        mPending.push_back({owner, std::move(job)});
+
+    startRunners(lock);
+}
+
+void RefinementExecutor::cancel( const void* owner )
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mPending.erase(std::remove_if(mPending.begin(), mPending.end(), [owner]( const Job& j ){ return j.owner == owner; }), mPending.end());
+    mJobDone.wait(lock, [this, owner](){ return !isRunning(owner); });
+}
+
+bool RefinementExecutor::isRunning( const void* owner ) const
+{
+    return std::find(mRunningOwners.begin(), mRunningOwners.end(), owner) != mRunningOwners.end();
+}
+
+void RefinementExecutor::startRunners( std::unique_lock<std::mutex>& lock )
+{
+    assert(lock.owns_lock() && lock.mutex() == &mMutex);
+
+    int runnable = 0;
+    for( const auto& job : mPending ){
+        if( !isRunning(job.owner) ) runnable++;
+    }
+
+    // runners between two jobs take one of the runnable jobs anyway
+    int idleRunners = mRunners - int(mRunningOwners.size());
+
+    if( mRunners >= mMaxConcurrency || runnable <= idleRunners ) return;
+
+    if( !mThreadPool && !mOwnThreadPool )
+        mOwnThreadPool = std::make_shared<ThreadPool>(mMaxConcurrency);
+
+    ThreadPool& pool = mThreadPool ? *mThreadPool : *mOwnThreadPool;
+    const unsigned generation = mPoolGeneration;
+
+    while( mRunners < mMaxConcurrency && runnable > idleRunners ){
+        mRunners++;
+        idleRunners++;
+        pool.submit([this, generation](){ runJobs(generation); });
+    }
+}
+
+void RefinementExecutor::runJobs( unsigned generation )
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    for(;;){
+        if( generation != mPoolGeneration ){
+            // the pool was replaced, the pending jobs continue on the current one
+            mRunners--;
+            startRunners(lock);
+            mJobDone.notify_all();
+            return;
+        }
+
+        auto next = std::find_if(mPending.begin(), mPending.end(), [this]( const Job& j ){ return !isRunning(j.owner); });
+
+        if( next == mPending.end() || mRunners > mMaxConcurrency ){
+            mRunners--;
+            mJobDone.notify_all();
+            return;
+        }
+
+        Job job = std::move(*next);
+        mPending.erase(next);
+        mRunningOwners.push_back(job.owner);
+
+        lock.unlock();
+        try {
+            job.work();
+        } catch( ... ){
+            // like a failed refinement, the model keeps its previous sphere
+        }
+        lock.lock();
+
+        job.work = nullptr; // release the captures before the owner may be gone
+        mRunningOwners.erase(std::find(mRunningOwners.begin(), mRunningOwners.end(), job.owner));
+        mJobDone.notify_all();
+    }
+}
+
+} // namespace singleeyefitter
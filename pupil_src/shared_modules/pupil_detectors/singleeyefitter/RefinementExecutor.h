@@ -0,0 +1,64 @@
+#ifndef singleeyefitter_refinementexecutor_h__
+#define singleeyefitter_refinementexecutor_h__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ThreadPool.h"
+
+
+namespace singleeyefitter {
+
+    // Queue for the model refinements of an EyeModelFitter.
+    //
+    // At most maxConcurrency refinements run at the same time, on the thread pool of the detector or, without one,
+    // on maxConcurrency workers of the executor which are kept between refinements. Every job belongs to an owner, a model.
+    // A new job replaces the pending job of its owner, since only the refinement with the latest observations matters,
+    // and the jobs of one owner never run at the same time.
+    class RefinementExecutor {
+        public:
+
+            explicit RefinementExecutor( int maxConcurrency = 2 );
+            RefinementExecutor( const RefinementExecutor& ) = delete;
+            RefinementExecutor& operator=( const RefinementExecutor& ) = delete;
+            ~RefinementExecutor(); // waits for the running jobs, pending jobs are dropped
+
+            // nullptr runs the jobs on workers of the executor
+            void setThreadPool( std::shared_ptr<ThreadPool> pool );
+            void setMaxConcurrency( int maxConcurrency );
+            int getMaxConcurrency() const;
+
+            // jobs must not throw, an exception ends the job
+            void submit( const void* owner, std::function<void()> job );
+            // drops the pending job of owner and waits until its running job is done
+            void cancel( const void* owner );
+
+        private:
+
+            struct Job {
+                const void* owner;
+                std::function<void()> work;
+            };
+
+            mutable std::mutex mMutex;
+            std::condition_variable mJobDone;
+            std::deque<Job> mPending;
+            std::vector<const void*> mRunningOwners;
+            int mRunners; // tasks on the pool which take jobs until none is left
+            int mMaxConcurrency;
+            unsigned mPoolGeneration; // runners of an older generation run on a replaced pool
+            std::shared_ptr<ThreadPool> mThreadPool;
+            std::shared_ptr<ThreadPool> mOwnThreadPool;
+
+            bool isRunning( const void* owner ) const;
+            void startRunners( std::unique_lock<std::mutex>& lock );
+            void runJobs( unsigned generation );
+    };
+
+} // namespace singleeyefitter
+
+#endif // singleeyefitter_refinementexecutor_h__
@@ -0,0 +1,64 @@
+#ifndef singleeyefitter_segmentmodelids_h__
+#define singleeyefitter_segmentmodelids_h__
+
+#include <algorithm>
+#include <vector>
+
+#include "common/types.h"
+
+
+namespace singleeyefitter {
+
+    // Joins the model ids of consecutive segments of a recording which were fitted by their own EyeModelFitter.
+    //
+    // Every fitter numbers its models from 1. The segments are joined in recording order, their models get ids
+    // after the ones of the segments before, except the first model of a segment, which continues the model
+    // before the segment (id and birth timestamp) if their spheres are closer than mergeDistance at the boundary.
+    class SegmentModelIDs {
+        public:
+
+            SegmentModelIDs() : mHasPrevious(false), mIDOffset(0) {};
+
+            // results[begin, end) is the next segment
+            void join( std::vector<Detector3DResult>& results, size_t begin, size_t end, double mergeDistance )
+            {
+                if( begin >= end )
+                    return;
+
+                const Detector3DResult& first = results[begin];
+                const int firstID = first.modelID;
+                const bool continues = mHasPrevious &&
+                    mPrevious.sphere != Sphere<double>::Null && first.sphere != Sphere<double>::Null &&
+                    (mPrevious.sphere.center - first.sphere.center).norm() < mergeDistance;
+                int maxID = 0;
+
+                for( size_t i = begin; i < end; i++ ){
+                    Detector3DResult& result = results[i];
+                    maxID = std::max(maxID, result.modelID);
+
+                    if( continues && result.modelID == firstID ){
+                        result.modelID = mPrevious.modelID;
+                        result.modelBirthTimestamp = mPrevious.modelBirthTimestamp;
+                    }else{
+                        result.modelID += mIDOffset;
+                    }
+                }
+
+                mIDOffset += maxID;
+                const Detector3DResult& last = results[end - 1];
+                mPrevious.sphere = last.sphere;
+                mPrevious.modelID = last.modelID;
+                mPrevious.modelBirthTimestamp = last.modelBirthTimestamp;
+                mHasPrevious = true;
+            }
+
+        private:
+
+            Detector3DResult mPrevious; // only the model of the last result
+            bool mHasPrevious;
+            int mIDOffset;
+    };
+
+} // namespace singleeyefitter
+
+#endif // singleeyefitter_segmentmodelids_h__
@@ -0,0 +1,174 @@
+#ifndef singleeyefitter_sphericaledgeindex_h__
+#define singleeyefitter_sphericaledgeindex_h__
+
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "common/types.h"
+#include "common/constants.h"
+
+namespace singleeyefitter {
+
+    // Grid index over edges on the eye sphere, used to count the edges in the band around a circle on the sphere
+    // without looking at every edge.
+    //
+    // The edges are binned by their spherical angles around the sphere center (theta and psi like math::cart2sph)
+    // and stored as structure of arrays sorted by bin, so the bins of one theta row are contiguous.
+    // A query only visits the bins of the spherical cap which contains its band.
+    // psi is taken relative to a reference angle, so the edges around it don't wrap around at +-pi.
+    class SphericalEdgeIndex {
+        public:
+
+            SphericalEdgeIndex() : mRadius(0), mBinSize(1), mPsiReference(0), mThetaMin(0), mPsiMin(0), mRows(0), mCols(0) {};
+
+            // edges have to be on the sphere, bins are binSize radians wide
+            void build(const Vector3& center, double radius, const Edges3D& edges, double binSize, double psiReference)
+            {
+                mCenter = center;
+                mRadius = radius;
+                mBinSize = binSize;
+                mPsiReference = psiReference;
+
+                const size_t count = edges.size();
+                mThetas.resize(count);
+                mPsis.resize(count);
+
+                double thetaMax = 0, psiMax = -constants::PI;
+                mThetaMin = constants::PI;
+                mPsiMin = constants::PI;
+
+                for (size_t i = 0; i < count; i++) {
+                    angles(edges[i], mThetas[i], mPsis[i]);
+                    mThetaMin = std::min(mThetaMin, mThetas[i]);
+                    mPsiMin = std::min(mPsiMin, mPsis[i]);
+                    thetaMax = std::max(thetaMax, mThetas[i]);
+                    psiMax = std::max(psiMax, mPsis[i]);
+                }
+
+                mRows = count ? int((thetaMax - mThetaMin) / binSize) + 1 : 0;
+                mCols = count ? int((psiMax - mPsiMin) / binSize) + 1 : 0;
+
+                // counting sort by bin
+                mBins.resize(count);
+                mBinStart.assign(size_t(mRows) * mCols + 1, 0);
+
+                for (size_t i = 0; i < count; i++) {
+                    mBins[i] = bin(mThetas[i], mPsis[i]);
+                    mBinStart[mBins[i] + 1]++;
+                }
+
+                for (size_t b = 1; b < mBinStart.size(); b++) {
+                    mBinStart[b] += mBinStart[b - 1];
+                }
+
+                mX.resize(count);
+                mY.resize(count);
+                mZ.resize(count);
+                mFill.assign(mBinStart.begin(), mBinStart.end() - 1);
+
+                for (size_t i = 0; i < count; i++) {
+                    const int slot = mFill[mBins[i]]++;
+                    mX[slot] = edges[i].x();
+                    mY[slot] = edges[i].y();
+                    mZ[slot] = edges[i].z();
+                }
+            }
+
+            // Counts the edges e with minDistanceSquared < |e - point|^2 < maxDistanceSquared and sums up their distances.
+            // point has to be on the sphere.
+            void countBand(const Vector3& point, double minDistanceSquared, double maxDistanceSquared, int& count, double& distanceSum) const
+            {
+                count = 0;
+                distanceSum = 0.0;
+
+                if (mRows == 0) return;
+
+                // central angle of the cap around point containing the band, with some room for rounding
+                const double chord = std::sqrt(maxDistanceSquared) / (2.0 * mRadius);
+                const double alpha = chord >= 1.0 ? constants::PI : 2.0 * std::asin(chord) + 1e-6;
+
+                double theta, psi;
+                angles(point, theta, psi);
+
+                const int rowBegin = std::max(0, int(std::floor((theta - alpha - mThetaMin) / mBinSize)));
+                const int rowEnd = std::min(mRows, int(std::floor((theta + alpha - mThetaMin) / mBinSize)) + 1);
+
+                if (rowBegin >= rowEnd) return;
+
+                // a cap containing a pole covers every psi
+                if (theta - alpha <= 0.0 || theta + alpha >= constants::PI) {
+                    countColumns(rowBegin, rowEnd, 0, mCols, point, minDistanceSquared, maxDistanceSquared, count, distanceSum);
+                    return;
+                }
+
+                // otherwise psi differs by at most asin(sin(alpha) / sin(theta)) within the cap
+                const double halfWidth = std::asin(std::min(1.0, std::sin(alpha) / std::sin(theta))) + 1e-6;
+
+                // the cap may wrap around at +-pi relative to the reference
+                for (double shift : {0.0, constants::TWO_PI, -constants::TWO_PI}) {
+                    const int colBegin = std::max(0, int(std::floor((psi - halfWidth + shift - mPsiMin) / mBinSize)));
+                    const int colEnd = std::min(mCols, int(std::floor((psi + halfWidth + shift - mPsiMin) / mBinSize)) + 1);
+
+                    if (colBegin < colEnd)
+                        countColumns(rowBegin, rowEnd, colBegin, colEnd, point, minDistanceSquared, maxDistanceSquared, count, distanceSum);
+                }
+            }
+
+        private:
+
+            Vector3 mCenter;
+            double mRadius;
+            double mBinSize;
+            double mPsiReference;
+            double mThetaMin, mPsiMin;
+            int mRows, mCols;
+
+            std::vector<double> mThetas, mPsis;
+            std::vector<int> mBins, mBinStart, mFill;
+            std::vector<double> mX, mY, mZ; // edges sorted by bin
+
+            void angles(const Vector3& point, double& theta, double& psi) const
+            {
+                const Vector3 v = point - mCenter;
+                theta = std::acos(std::max(-1.0, std::min(1.0, v.y() / v.norm())));
+                psi = std::atan2(v.z(), v.x()) - mPsiReference;
+
+                if (psi > constants::PI) psi -= constants::TWO_PI;
+                else if (psi <= -constants::PI) psi += constants::TWO_PI;
+            }
+
+            int bin(double theta, double psi) const
+            {
+                const int row = std::min(mRows - 1, int((theta - mThetaMin) / mBinSize));
+                const int col = std::min(mCols - 1, int((psi - mPsiMin) / mBinSize));
+                return row * mCols + col;
+            }
+
+            void countColumns(int rowBegin, int rowEnd, int colBegin, int colEnd, const Vector3& point,
+                              double minDistanceSquared, double maxDistanceSquared, int& count, double& distanceSum) const
+            {
+                typedef Eigen::Map<const Eigen::ArrayXd> Coordinates;
+
+                for (int row = rowBegin; row < rowEnd; row++) {
+                    const int begin = mBinStart[row * mCols + colBegin];
+                    const int size = mBinStart[row * mCols + colEnd] - begin;
+
+                    if (size == 0) continue;
+
+                    // vectorized by Eigen
+                    const auto distanceSquared = (Coordinates(&mX[begin], size) - point.x()).square()
+                                                 + (Coordinates(&mY[begin], size) - point.y()).square()
+                                                 + (Coordinates(&mZ[begin], size) - point.z()).square();
+                    const auto inBand = distanceSquared < maxDistanceSquared && distanceSquared > minDistanceSquared;
+                    count += int(inBand.count());
+                    distanceSum += inBand.select(distanceSquared.sqrt(), 0.0).sum();
+                }
+            }
+    };
+
+} // namespace singleeyefitter
+
+#endif // singleeyefitter_sphericaledgeindex_h__
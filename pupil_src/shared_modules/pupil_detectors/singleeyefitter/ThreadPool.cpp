@@ -0,0 +1,91 @@
+#include "ThreadPool.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+#include <algorithm>
+
+namespace singleeyefitter {
+
+ThreadPool::ThreadPool( int threads, const std::vector<int>& cpus ) : mStopping(false), mHasAffinity(true)
+{
+    if( threads <= 0 )
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for( int i = 0; i < threads; i++ ){
+        mWorkers.emplace_back(&ThreadPool::run, this);
+
+        if( !cpus.empty() )
+            mHasAffinity = setAffinity(mWorkers.back(), cpus) && mHasAffinity;
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mTaskAdded.notify_all();
+
+    for( auto& worker : mWorkers )
+        worker.join();
+}
+
+std::future<void> ThreadPool::submit( std::function<void()> task )
+{
+    std::packaged_task<void()> packaged(std::move(task));
+    std::future<void> future = packaged.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTasks.push_back(std::move(packaged));
+    }
+    mTaskAdded.notify_one();
+    return future;
+}
+
+void ThreadPool::run()
+{
+    for(;;){
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mTaskAdded.wait(lock, [this](){ return mStopping || !mTasks.empty(); });
+
+            if( mTasks.empty() ) return; // stopping
+
+            task = std::move(mTasks.front());
+            mTasks.pop_front();
+        }
+        task(); // exceptions end up in the future
+    }
+}
+
+bool ThreadPool::setAffinity( std::thread& thread, const std::vector<int>& cpus )
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for( int cpu : cpus ){
+        if( cpu >= 0 && cpu < CPU_SETSIZE ) CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for( int cpu : cpus ){
+        if( cpu >= 0 && cpu < int(8 * sizeof(mask)) ) mask |= DWORD_PTR(1) << cpu;
+    }
+    return mask != 0 && SetThreadAffinityMask(static_cast<HANDLE>(thread.native_handle()), mask) != 0;
+#else
+    return false;
+#endif
+}
+
+} // namespace singleeyefitter
@@ -0,0 +1,105 @@
+#ifndef singleeyefitter_threadpool_h__
+#define singleeyefitter_threadpool_h__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace singleeyefitter {
+
+    // Fixed number of worker threads sharing one queue of tasks.
+    //
+    // One pool is shared by the parts of a detector which run work in parallel, so the detector never uses
+    // more threads than the pool has, no matter how much of that work is pending at the same time.
+    // With cpus the workers only run on these cores, e.g. to keep the detectors of both eyes on separate cores.
+    class ThreadPool {
+        public:
+
+            // threads <= 0 uses one worker per core
+            // cpus are core indices, setting the affinity is only supported on Linux and Windows and ignored elsewhere
+            explicit ThreadPool( int threads = 0, const std::vector<int>& cpus = std::vector<int>() );
+            ThreadPool( const ThreadPool& ) = delete;
+            ThreadPool& operator=( const ThreadPool& ) = delete;
+            ~ThreadPool(); // runs the queued tasks before the workers stop
+
+            int size() const { return int(mWorkers.size()); };
+            // false if cpus were given but couldn't be set
+            bool hasAffinity() const { return mHasAffinity; };
+
+            std::future<void> submit( std::function<void()> task );
+
+            // Calls body(i) for every i in [begin, end) and returns when all calls are done.
+            // The calling thread takes indices as well, so it is safe to call from a task of the pool. body must not throw.
+            template<typename Body>
+            void parallelFor( int begin, int end, const Body& body );
+
+        private:
+
+            std::vector<std::thread> mWorkers;
+            std::deque<std::packaged_task<void()>> mTasks;
+            std::mutex mMutex;
+            std::condition_variable mTaskAdded;
+            bool mStopping;
+            bool mHasAffinity;
+
+            void run();
+            static bool setAffinity( std::thread& thread, const std::vector<int>& cpus );
+    };
+
+
+    template<typename Body>
+    void ThreadPool::parallelFor( int begin, int end, const Body& body )
+    {
+        const int count = end - begin;
+        if( count <= 0 ) return;
+
+        if( count == 1 || mWorkers.empty() ){
+            for( int i = begin; i < end; i++ ) body(i);
+            return;
+        }
+
+        // helpers which start after all indices are taken return right away, so nobody waits for a queued helper
+        struct Shared {
+            std::atomic<int> next;
+            std::atomic<int> done;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto shared = std::make_shared<Shared>();
+        shared->next = begin;
+        shared->done = 0;
+
+        auto work = [shared, &body, end, count](){
+            int finished = 0;
+
+            for( int i = shared->next++; i < end; i = shared->next++ ){
+                body(i);
+                finished++;
+            }
+
+            if( finished > 0 && shared->done.fetch_add(finished) + finished == count ){
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                shared->finished.notify_all();
+            }
+        };
+
+        const int helpers = std::min(count, size() + 1) - 1;
+        for( int i = 0; i < helpers; i++ ) submit(work);
+
+        work();
+
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->finished.wait(lock, [&](){ return shared->done == count; });
+    }
+
+} // namespace singleeyefitter
+
+#endif // singleeyefitter_threadpool_h__
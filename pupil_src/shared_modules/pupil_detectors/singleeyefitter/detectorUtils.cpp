@@ -128,6 +128,21 @@ namespace singleeyefitter {
     Contours_2D detector::split_rough_contours_optimized(const Contours_2D& contours, const Scalar max_angle, const int min_contour_size)
     {
         Contours_2D split_contours;
+        split_rough_contours_optimized(contours, max_angle, min_contour_size, split_contours);
+        return split_contours;
+    }
+
+    template< typename Scalar >
+    void detector::split_rough_contours_optimized(const Contours_2D& contours, const Scalar max_angle, const int min_contour_size, Contours_2D& split_contours)
+    {
+        size_t split_count = 0;
+        // assign to already existing contours first, so their memory gets reused
+        auto add_split_contour = [&](Contour_2D::const_iterator first, Contour_2D::const_iterator last) {
+            if (split_count == split_contours.size())
+                split_contours.emplace_back();
+
+            split_contours[split_count++].assign(first, last);
+        };
 
         for (auto it = contours.begin(); it != contours.end(); it++) {
             const Contour_2D& contour  = *it;
@@ -151,7 +166,7 @@ namespace singleeyefitter {
 
                     //skip segments shorter than min_contour_size points
                     if (std::distance(last_contour_end_position, current_contour_end_position + 1)  >= min_contour_size) {
-                        split_contours.emplace_back(last_contour_end_position,  current_contour_end_position + 1); // range is [first, last)
+                        add_split_contour(last_contour_end_position,  current_contour_end_position + 1); // range is [first, last)
                     }
 
                     last_contour_end_position = current_contour_end_position;
@@ -163,10 +178,10 @@ namespace singleeyefitter {
 
             // this is the last contour we don't capture in the for loop, or the whole contour if we didn't split it
             if (std::distance(last_contour_end_position, contour.end()) >= min_contour_size)
-                split_contours.emplace_back(last_contour_end_position,  contour.end());
+                add_split_contour(last_contour_end_position,  contour.end());
         }
 
-        return split_contours;
+        split_contours.resize(split_count);
     }
 
     std::pair<ContourIndices, ContourIndices> detector::divide_strong_and_weak_contours(
@@ -174,56 +189,102 @@ namespace singleeyefitter {
         const float strong_perimeter_ratio_range_min, const float strong_perimeter_ratio_range_max,
         const float strong_area_ratio_range_min, const float strong_area_ratio_range_max)
     {
-        ContourIndices strong_contours, weak_contours;
-        int index = 0;
+        // normalize with the region covered by all contours
+        cv::Rect bounds;
 
         for (const auto& contour : contours) {
-            if (contour.size() >= 5) { // because fitEllipse needs at least 5 points
-                cv::RotatedRect ellipse = cv::fitEllipse(contour);
-
-                //is this ellipse a plausible candidate for a pupil?
-                if (is_ellipse(ellipse)) {
-                    auto e = toEllipse<double>(ellipse);
-                    EllipseDistCalculator<double> ellipseDistance(e);
-                    auto sum_function = [&](cv::Point & point) {return std::pow(std::abs(ellipseDistance(point.x, point.y)), 2);};
-                    double point_distances = fun::sum(sum_function, contour);
-                    double fit_variance = point_distances / double(contour.size());
-
-                    if (fit_variance < ellipse_fit_treshold) {
-                        auto ratio = ellipse_contour_support_ratio(e, contour);
-                        double area_ratio = ratio.first;
-                        double perimeter_ratio = ratio.second;
-
-                        // same as in original
-                        if (strong_perimeter_ratio_range_min <= perimeter_ratio &&
-                                strong_perimeter_ratio_range_max >= perimeter_ratio &&
-                                strong_area_ratio_range_min <= area_ratio &&
-                                strong_area_ratio_range_max >=  area_ratio) {
-                            strong_contours.push_back(index);
-                            // if (use_debug_image)
-                            // {
-                            //  cv::polylines(debug_image, contour, false, mRoyalBlue_color, 4);
-                            //  cv::ellipse(debug_image, ellipse, mBlue_color);
-                            // }
-
-                        } else {
-                            weak_contours.push_back(index);
-                            // if (use_debug_image)
-                            // {
-                            //  cv::polylines(debug_image, contour, false, mBlue_color, 2);
-                            //  cv::ellipse(debug_image, ellipse, mBlue_color);
-                            // }
-                        }
-                    }
-                }
-            }
+            if (!contour.empty())
+                bounds |= cv::boundingRect(contour);
+        }
 
-            index++;
+        const EllipseFitter2D fitter(cv::Point2d(bounds.x + bounds.width / 2.0, bounds.y + bounds.height / 2.0), std::max(bounds.width, bounds.height) / 2.0);
+        EllipseFitter2D::Scatters scatters;
+        scatters.reserve(contours.size());
+
+        for (const auto& contour : contours) {
+            scatters.push_back(fitter.scatter(contour));
         }
 
+        ContourIndices strong_contours, weak_contours;
+        divide_strong_and_weak_contours(contours, scatters, fitter, is_ellipse, ellipse_fit_treshold,
+                                        strong_perimeter_ratio_range_min, strong_perimeter_ratio_range_max,
+                                        strong_area_ratio_range_min, strong_area_ratio_range_max,
+                                        strong_contours, weak_contours);
         return std::make_pair(std::move(strong_contours), std::move(weak_contours));
     }
 
+    void detector::divide_strong_and_weak_contours(
+        const Contours_2D& contours, const EllipseFitter2D::Scatters& scatters, const EllipseFitter2D& fitter,
+        const EllipseEvaluation2D& is_ellipse, const float ellipse_fit_treshold,
+        const float strong_perimeter_ratio_range_min, const float strong_perimeter_ratio_range_max,
+        const float strong_area_ratio_range_min, const float strong_area_ratio_range_max,
+        ContourIndices& strong_contours, ContourIndices& weak_contours, ThreadPool* pool)
+    {
+        enum Strength : int { None, Weak, Strong };
+
+        auto evaluate = [&](int index) -> Strength {
+            const auto& contour = contours[index];
+
+            if (contour.size() < 5) // because fitEllipse needs at least 5 points
+                return None;
+
+            cv::RotatedRect ellipse;
+
+            // fall back to opencv for degenerated point sets
+            if (!fitter.fit(scatters[index], ellipse))
+                ellipse = cv::fitEllipse(contour);
+
+            //is this ellipse a plausible candidate for a pupil?
+            if (!is_ellipse(ellipse))
+                return None;
+
+            auto e = toEllipse<double>(ellipse);
+            EllipseDistCalculator<double> ellipseDistance(e);
+            double point_distances = ellipseDistance.batch(contour, 0.0).squared_sum;
+            double fit_variance = point_distances / double(contour.size());
+
+            if (fit_variance >= ellipse_fit_treshold)
+                return None;
+
+            auto ratio = ellipse_contour_support_ratio(e, contour);
+            double area_ratio = ratio.first;
+            double perimeter_ratio = ratio.second;
+
+            // same as in original
+            if (strong_perimeter_ratio_range_min <= perimeter_ratio &&
+                    strong_perimeter_ratio_range_max >= perimeter_ratio &&
+                    strong_area_ratio_range_min <= area_ratio &&
+                    strong_area_ratio_range_max >=  area_ratio) {
+                return Strong;
+            }
+
+            return Weak;
+        };
+
+        const int count = contours.size();
+        // the strengths are stored in weak_contours, which is compacted to the weak indices afterwards
+        ContourIndices& strengths = weak_contours;
+        strengths.resize(count);
+
+        // a few contours are evaluated faster than they are handed to the pool
+        if (pool && count >= 16)
+            pool->parallelFor(0, count, [&](int index) { strengths[index] = evaluate(index); });
+        else
+            for (int index = 0; index < count; index++) strengths[index] = evaluate(index);
+
+        strong_contours.clear();
+        int weak_count = 0;
+
+        for (int index = 0; index < count; index++) {
+            if (strengths[index] == Strong)
+                strong_contours.push_back(index);
+            else if (strengths[index] == Weak)
+                weak_contours[weak_count++] = index; // weak_count <= index, so the strength is already read
+        }
+
+        weak_contours.resize(weak_count);
+    }
+
     std::pair<double, double> detector::ellipse_contour_support_ratio(const Ellipse& ellipse, const Contour_2D& contour)
     {
         std::vector<cv::Point> hull;
@@ -239,8 +300,7 @@ namespace singleeyefitter {
     {
         auto ellipse = cv::fitEllipse(contour);
         EllipseDistCalculator<double> ellipseDistance(toEllipse<double>(ellipse));
-        auto sum_function = [&](cv::Point & point) {return std::pow(std::abs(ellipseDistance(point.x, point.y)), 2.0);};
-        double point_distances = fun::sum(sum_function, contour);
+        double point_distances = ellipseDistance.batch(contour, 0.0).squared_sum;
         double fit_variance = point_distances / double(contour.size());
         return fit_variance;
     };
@@ -251,6 +311,8 @@ namespace singleeyefitter {
     template Contours_2D detector::split_rough_contours(const Contours_2D& contours, const double angle);
     template Contours_2D detector::split_rough_contours_optimized(const Contours_2D& contours, const float angle, const int min_contour_size);
     template Contours_2D detector::split_rough_contours_optimized(const Contours_2D& contours, const double angle, const int min_contour_size);
+    template void detector::split_rough_contours_optimized(const Contours_2D& contours, const float angle, const int min_contour_size, Contours_2D& split_contours);
+    template void detector::split_rough_contours_optimized(const Contours_2D& contours, const double angle, const int min_contour_size, Contours_2D& split_contours);
 
 
 
@@ -5,6 +5,8 @@
 #include <opencv2/core.hpp>
 #include "common/types.h"
 #include "EllipseEvaluation2D.h"
+#include "Fit/EllipseFit2D.h"
+#include "ThreadPool.h"
 
 
 namespace singleeyefitter {
@@ -24,12 +26,26 @@ namespace singleeyefitter {
         template< typename Scalar >
         Contours_2D split_rough_contours_optimized(const Contours_2D& contours, const Scalar max_angle , const int min_contour_size);
 
+        // same as above, but writes into split_contours and reuses the memory of the contours already in there
+        template< typename Scalar >
+        void split_rough_contours_optimized(const Contours_2D& contours, const Scalar max_angle , const int min_contour_size, Contours_2D& split_contours);
+
         // returns the indices to strong and weak contours
         std::pair<ContourIndices, ContourIndices> divide_strong_and_weak_contours(
             const Contours_2D& contours, const EllipseEvaluation2D& is_ellipse, const float ellipse_fit_treshold,
             const float strong_perimeter_ratio_range_min, const float strong_perimeter_ratio_range_max,
             const float strong_area_ratio_range_min, const float strong_area_ratio_range_max);
 
+        // same as above, but fits the ellipses to the precomputed scatter matrices of the contours
+        // and replaces the content of strong_contours and weak_contours, so they can be reused for every frame
+        // with a pool the contours are evaluated in parallel, the indices are the same
+        void divide_strong_and_weak_contours(
+            const Contours_2D& contours, const EllipseFitter2D::Scatters& scatters, const EllipseFitter2D& fitter,
+            const EllipseEvaluation2D& is_ellipse, const float ellipse_fit_treshold,
+            const float strong_perimeter_ratio_range_min, const float strong_perimeter_ratio_range_max,
+            const float strong_area_ratio_range_min, const float strong_area_ratio_range_max,
+            ContourIndices& strong_contours, ContourIndices& weak_contours, ThreadPool* pool = nullptr);
+
 
         //calculates how much ellipse is supported by the contour
         // return the ratio of area and circumference of the ellipse to the contour
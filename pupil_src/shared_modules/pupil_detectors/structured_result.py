@@ -0,0 +1,209 @@
+"""
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+"""
+
+from collections.abc import MutableMapping
+from itertools import islice
+
+import numpy as np
+
+# number of records a detector keeps, a record is overwritten this many detections later
+RESULT_RECORDS = 256
+
+# frames a batch detection reads at a time, their images are kept until the chunk is detected
+BATCH_CHUNK_SIZE = 1200
+
+# field order and types have to match Pupil2DRecord and Pupil3DRecord in detector_utils.pxd
+_2D_FIELDS = [
+    "timestamp",
+    "confidence",
+    "diameter",
+    "norm_pos_x",
+    "norm_pos_y",
+    "ellipse_center_x",
+    "ellipse_center_y",
+    "ellipse_minor_axis",
+    "ellipse_major_axis",
+    "ellipse_angle",
+]
+
+_3D_FIELDS = _2D_FIELDS + [
+    "diameter_3d",
+    "circle_3d_center_x",
+    "circle_3d_center_y",
+    "circle_3d_center_z",
+    "circle_3d_normal_x",
+    "circle_3d_normal_y",
+    "circle_3d_normal_z",
+    "circle_3d_radius",
+    "sphere_center_x",
+    "sphere_center_y",
+    "sphere_center_z",
+    "sphere_radius",
+    "projected_sphere_center_x",
+    "projected_sphere_center_y",
+    "projected_sphere_minor_axis",
+    "projected_sphere_major_axis",
+    "projected_sphere_angle",
+    "model_confidence",
+    "model_birth_timestamp",
+    "theta",
+    "phi",
+]
+
+PUPIL_2D_DTYPE = np.dtype([(name, np.float64) for name in _2D_FIELDS])
+PUPIL_3D_DTYPE = np.dtype(
+    [(name, np.float64) for name in _3D_FIELDS] + [("model_id", np.int32)]
+)
+
+
+def record_to_dict(record):
+    """Builds the pupil datum of a record, the same dict the detectors return by default"""
+    r = record
+    result = {
+        "topic": "pupil",
+        "confidence": float(r["confidence"]),
+        "timestamp": float(r["timestamp"]),
+        "diameter": float(r["diameter"]),
+        "norm_pos": (float(r["norm_pos_x"]), float(r["norm_pos_y"])),
+        "ellipse": {
+            "center": (float(r["ellipse_center_x"]), float(r["ellipse_center_y"])),
+            "axes": (float(r["ellipse_minor_axis"]), float(r["ellipse_major_axis"])),
+            "angle": float(r["ellipse_angle"]),
+        },
+    }
+
+    if record.dtype != PUPIL_3D_DTYPE:
+        result["method"] = "2d c++"
+        return result
+
+    result["method"] = "3d c++"
+    result["diameter_3d"] = float(r["diameter_3d"])
+    result["circle_3d"] = {
+        "center": (
+            float(r["circle_3d_center_x"]),
+            float(r["circle_3d_center_y"]),
+            float(r["circle_3d_center_z"]),
+        ),
+        "normal": (
+            float(r["circle_3d_normal_x"]),
+            float(r["circle_3d_normal_y"]),
+            float(r["circle_3d_normal_z"]),
+        ),
+        "radius": float(r["circle_3d_radius"]),
+    }
+    result["sphere"] = {
+        "center": (
+            float(r["sphere_center_x"]),
+            float(r["sphere_center_y"]),
+            float(r["sphere_center_z"]),
+        ),
+        "radius": float(r["sphere_radius"]),
+    }
+    result["projected_sphere"] = {
+        "center": (
+            float(r["projected_sphere_center_x"]),
+            float(r["projected_sphere_center_y"]),
+        ),
+        "axes": (
+            float(r["projected_sphere_minor_axis"]),
+            float(r["projected_sphere_major_axis"]),
+        ),
+        "angle": float(r["projected_sphere_angle"]),
+    }
+    result["model_confidence"] = float(r["model_confidence"])
+    result["model_id"] = int(r["model_id"])
+    result["model_birth_timestamp"] = float(r["model_birth_timestamp"])
+    result["theta"] = float(r["theta"])
+    result["phi"] = float(r["phi"])
+    return result
+
+
+def frame_chunks(frames, chunk_size, segment_length=0):
+    """Splits any iterable of frames into lists of at most chunk_size consecutive frames.
+
+    With a segment_length the chunks hold whole segments, so a batch detection splits the
+    frames into the same segments no matter how they are chunked.
+    """
+    if segment_length > 0:
+        chunk_size = max(1, chunk_size // segment_length) * segment_length
+    chunk_size = max(1, chunk_size)
+
+    frames = iter(frames)
+    while True:
+        chunk = list(islice(frames, chunk_size))
+        if not chunk:
+            return
+        yield chunk
+
+
+class StaleResultError(RuntimeError):
+    """The record of a structured result was overwritten by a later detection"""
+
+
+class StructuredPupilResult(MutableMapping):
+    """Result of a detection with structured=True.
+
+    `record` is a view into the records of the detector, valid for RESULT_RECORDS
+    detections. The pupil datum dict is only built when it is accessed like a dict,
+    use `to_dict` to keep a result for longer. `sequences` holds the number of the
+    detection which wrote each record, a result whose record was overwritten since
+    raises StaleResultError instead of returning the values of another detection.
+    """
+
+    __slots__ = ("records", "sequences", "index", "sequence", "_extra", "_dict")
+
+    def __init__(self, records, sequences, index, extra=None):
+        self.records = records
+        self.sequences = sequences
+        self.index = index
+        self.sequence = int(sequences[index])
+        self._extra = extra
+        self._dict = None
+
+    @property
+    def stale(self):
+        return int(self.sequences[self.index]) != self.sequence
+
+    @property
+    def record(self):
+        if self.stale:
+            raise StaleResultError(
+                "The record of detection {} was overwritten, results are only kept "
+                "for {} detections".format(self.sequence, len(self.records))
+            )
+        return self.records[self.index]
+
+    def to_dict(self):
+        if self._dict is None:
+            self._dict = record_to_dict(self.record)
+            if self._extra:
+                self._dict.update(self._extra)
+        return self._dict
+
+    def __getitem__(self, key):
+        return self.to_dict()[key]
+
+    def __setitem__(self, key, value):
+        self.to_dict()[key] = value
+
+    def __delitem__(self, key):
+        del self.to_dict()[key]
+
+    def __iter__(self):
+        return iter(self.to_dict())
+
+    def __len__(self):
+        return len(self.to_dict())
+
+    def __repr__(self):
+        if self._dict is None and self.stale:
+            return "StructuredPupilResult(<stale detection {}>)".format(self.sequence)
+        return "StructuredPupilResult({!r})".format(self.to_dict())
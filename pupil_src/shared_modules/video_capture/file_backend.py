@@ -45,6 +45,7 @@ class Frame(object):
         self.index = int(index)
         self._img = None
         self._gray = None
+        self._luminance = None
         self.jpeg_buffer = None
         self.yuv_buffer = None
         self.height, self.width = av_frame.height, av_frame.width
@@ -63,15 +64,22 @@ class Frame(object):
         return self.img
 
     @property
-    def gray(self):
-        if self._gray is None:
+    def luminance(self):
+        """Y plane of the decoded frame without copying it, rows can be padded"""
+        if self._luminance is None:
             plane = self._av_frame.planes[0]
-            self._gray = np.frombuffer(plane, np.uint8)
+            self._luminance = np.frombuffer(plane, np.uint8)
             try:
-                self._gray.shape = self.height, self.width
+                self._luminance.shape = self.height, self.width
             except ValueError:
-                self._gray = self._gray.reshape(-1, plane.line_size)
-                self._gray = np.ascontiguousarray(self._gray[:, : self.width])
+                self._luminance = self._luminance.reshape(-1, plane.line_size)
+                self._luminance = self._luminance[: self.height, : self.width]
+        return self._luminance
+
+    @property
+    def gray(self):
+        if self._gray is None:
+            self._gray = np.ascontiguousarray(self.luminance)
         return self._gray
 
 
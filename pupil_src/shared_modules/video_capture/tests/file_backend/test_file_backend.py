@@ -1,8 +1,9 @@
 import logging
 import pytest
 import av
+import numpy as np
 from multiprocessing import cpu_count
-from video_capture.file_backend import File_Source, Decoder, OnDemandDecoder
+from video_capture.file_backend import File_Source, Decoder, OnDemandDecoder, Frame
 from video_capture.base_backend import NoMoreVideoError
 from common import broken_data, multiple_data, single_data
 
@@ -72,3 +73,13 @@ def test_get_streams(single_fill_gaps, caplog):
     stream = single_fill_gaps._get_streams(single_fill_gaps.container, False)
     assert isinstance(
         stream[0], OnDemandDecoder)
+
+
+def test_frame_luminance():
+    container = av.open(single_data)
+    av_frame = next(container.decode(video=0))
+    frame = Frame(0.0, av_frame, 0)
+    assert frame.luminance.shape == (frame.height, frame.width)
+    assert frame.luminance.strides[1] == 1
+    assert np.array_equal(frame.luminance, frame.gray)
+    assert frame.gray.flags["C_CONTIGUOUS"]
@@ -0,0 +1,26 @@
+"""
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+"""
+
+if __name__ == "__main__":
+    import subprocess as sp
+
+    shared_cpp_include_path = "-I../../shared_cpp/include/ "
+
+    s = (
+        "g++ -std=c++11 -O2 -pthread "
+        + shared_cpp_include_path
+        + " ringLoggerTest.cpp -o ringLoggerTest"
+    )
+    sp.call(s, shell=True)
+
+    print("BUILD COMPLETE ______________________")
+    sp.call("./ringLoggerTest", shell=True)
+    sp.call("rm ringLoggerTest", shell=True)
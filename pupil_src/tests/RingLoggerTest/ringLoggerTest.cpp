@@ -0,0 +1,111 @@
+/*
+(*)~---------------------------------------------------------------------------
+Pupil - eye tracking platform
+Copyright (C) 2012-2019 Pupil Labs
+
+Distributed under the terms of the GNU
+Lesser General Public License (LGPL v3.0).
+See COPYING and COPYING.LESSER for license details.
+---------------------------------------------------------------------------~(*)
+*/
+
+// Several threads log into one ring while it is drained. The writers wait for the reader, so every record has to
+// arrive once and in order per writer. A burst without a reader has to count the records which didn't fit as dropped.
+
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logger/ringlogger.h"
+
+int main()
+{
+    std::cout << "Start Test" << std::endl;
+
+    using namespace pupillabs;
+    LogRing ring(64);
+    const int threads = 4;
+    const int messages = 100000;
+    // records of a writer which haven't been received yet, the writers stay below the capacity of the ring together
+    const int window = 15;
+    std::atomic<int> running(threads);
+    std::vector<std::atomic<int>> receivedPerWriter(threads);
+    for (auto& r : receivedPerWriter) r = 0;
+    std::vector<std::thread> writers;
+    LogRecord record;
+
+    RingLogger filtered("Filtered", ring);
+    filtered.setLogLevel(LogLevel::WARNING);
+    filtered.info("not logged");
+    filtered.error("%s", "logged");
+    bool passed = ring.pop(record) && record.level == static_cast<int>(LogLevel::ERROR) && std::string(record.message) == "logged";
+    passed &= !ring.pop(record);
+
+    for (int t = 0; t < threads; t++) {
+        writers.emplace_back([&, t]() {
+            RingLogger logger("Writer", ring);
+            int written = 0;
+
+            // the debug messages of every second writer are filtered at runtime
+            if (t % 2) logger.setLogLevel(LogLevel::INFO);
+
+            auto wait = [&]() {
+                while (written - receivedPerWriter[t] >= window) std::this_thread::yield();
+            };
+
+            for (int i = 0; i < messages; i++) {
+                wait();
+                logger.info("%d %d", t, 2 * i);
+                written++;
+
+                if (t % 2 == 0) {
+                    wait();
+                    logger.debug("%d %d", t, 2 * i + 1);
+                    written++;
+                }
+            }
+
+            running--;
+        });
+    }
+
+    std::vector<int> next(threads, 0);
+    size_t received = 0, dropped = 0;
+
+    for (;;) {
+        const bool done = running == 0;
+        while (ring.pop(record)) {
+            int t, i;
+            std::sscanf(record.message, "%d %d", &t, &i);
+            // records of one writer arrive in order and without gaps, except for the filtered debug messages
+            passed &= i == next[t];
+            next[t] = i + (t % 2 ? 2 : 1);
+            receivedPerWriter[t]++;
+            received++;
+        }
+        dropped += ring.takeDropped();
+        if (done) break;
+        std::this_thread::yield();
+    }
+
+    for (auto& w : writers) w.join();
+
+    const size_t expected = size_t(threads) * messages + size_t(threads / 2) * messages;
+    std::cout << "received: " << received << " dropped: " << dropped << " of " << expected << std::endl;
+    passed &= received == expected && dropped == 0;
+
+    // without a reader only the capacity of the ring arrives
+    RingLogger burst("Burst", ring);
+    const int burstMessages = 1000;
+    for (int i = 0; i < burstMessages; i++) burst.info("%d", i);
+
+    size_t burstReceived = 0;
+    while (ring.pop(record)) burstReceived++;
+    const size_t burstDropped = ring.takeDropped();
+    std::cout << "burst received: " << burstReceived << " dropped: " << burstDropped << " of " << burstMessages << std::endl;
+    passed &= burstReceived == 64 && burstReceived + burstDropped == burstMessages;
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}